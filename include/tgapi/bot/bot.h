@@ -3,6 +3,10 @@
 #include <fstream>
 
 #include "configuration/configuration.h"
+#include "tgapi/bot/session_store.h"
+#include "tgapi/bot/timer_service.h"
+#include "tgapi/bot/update_dispatcher.h"
+#include "tgapi/bot/update_recorder.h"
 #include "tgapi/command/command_module.h"
 #include "tgapi/rest_client.h"
 #include "tgapi/types/api_types.h"
@@ -16,57 +20,17 @@ struct SendMessageParams {
     std::string Text;
     std::optional<MessageEntities> Entities;
     std::optional<ReplyParameters> Reply;
+    std::optional<InlineKeyboardMarkup> ReplyMarkup;
 };
 
-class TimerReply final {
-    void consume_reply();
-public:
-
-    explicit TimerReply(long handle);
-
-    TimerReply(const TimerReply&) = delete;
-    TimerReply(TimerReply&&) = delete;
-    TimerReply& operator=(const TimerReply&) = delete;
-    TimerReply& operator=(TimerReply&&) = delete;
-    ~TimerReply() = default;
-
-    void set_delete();
-    void update_interval(long time);
-
-    [[nodiscard]] bool is_delete() const;
-    [[nodiscard]] bool is_interval() const;
-
-    [[nodiscard]] long interval() const;
-    [[nodiscard]] long handle() const;
-
-private:
-    bool _consumed { false };
-    bool _delete { false };
-    long _newIntervalMs { -1 };
-    long _handle { 0 };
+struct SetWebhookParams {
+    std::string Url;
+    std::optional<int> MaxConnections;
+    std::optional<AllowedUpdates> Allowed; // if not set, derived from the interaction module
+    bool DropPendingUpdates { false };
 };
 
-class TimerService final {
-
-    class Impl;
-
-public:
-
-    TimerService();
-
-    TimerService(const TimerService&) = delete;
-    TimerService(TimerService&&) = delete;
-    TimerService& operator=(const TimerService&) = delete;
-    TimerService& operator=(TimerService&&) = delete;
-    ~TimerService();
-
-    void add_timer(const std::function<void(TimerReply&)>& callback, long handle, long interval, bool looping);
-    void update_timer(long handle, long interval);
-    bool delete_timer(long handle);
-
-private:
-    UniquePtr<Impl> _impl;
-};
+class BotHost;
 
 class TelegramBot final
 {
@@ -74,25 +38,94 @@ class TelegramBot final
 
 public:
 
+    /**
+     * Create standalone bot, owning its executor, rest client and timer service
+     */
     TelegramBot(config::Store config, UniquePtr<BotInteractionModuleBase> interaction);
 
+    /**
+     * Create bot sharing executor, rest client and timer service of the host
+     */
+    TelegramBot(BotHost& host, config::Store config, UniquePtr<BotInteractionModuleBase> interaction);
+
     TelegramBot(const TelegramBot&) = delete;
     TelegramBot(TelegramBot&&) = delete;
     TelegramBot& operator=(const TelegramBot&) = delete;
     TelegramBot& operator=(TelegramBot&&) = delete;
+
+    /**
+     * Stop receiving updates and wait for callbacks which use the bot. Must not be called from bot handlers
+     */
     ~TelegramBot();
 
     [[maybe_unused]] Future<Result<User>>      login_async();
     [[maybe_unused]] Future<Result<Message>>   send_message_async(const SendMessageParams& parms);
     [[maybe_unused]] Future<Result<Message>>   send_message_async(const ChatId& chatId, std::string_view message);
-
+    [[maybe_unused]] Future<Result<bool>>      set_webhook_async(const SetWebhookParams& parms);
+    [[maybe_unused]] Future<Result<bool>>      answer_callback_query_async(const AnswerCallbackQueryParams& parms);
+    [[maybe_unused]] Future<Result<bool>>      answer_pre_checkout_query_async(const AnswerPreCheckoutQueryParams& parms);
+    [[maybe_unused]] Future<Result<bool>>      answer_inline_query_async(const AnswerInlineQueryParams& parms);
+
+    /**
+     * Start long polling and block calling thread
+     */
     void begin_long_polling();
 
+    /**
+     * Start long polling on the bot executor without blocking
+     */
+    void start_long_polling();
+
+    /**
+     * Stop receiving updates. Does not block
+     */
+    void stop();
+
+    /**
+     * Stop receiving updates and wait for in-flight handlers and requests to finish.
+     * Update offset is saved so that no update is lost or received twice after restart.
+     * Standalone bot also joins all its threads. Must not be called from bot handlers
+     * @param deadline  Time point to give up waiting at
+     * @return True if all handlers and requests have finished before deadline
+     */
+    bool drain(std::chrono::steady_clock::time_point deadline);
+
+    /**
+     * Handle update received by webhook
+     * @param payload   Raw update json
+     * @return False if update was rejected because handlers are saturated (respond with 429)
+     */
+    bool handle_webhook_update(std::string_view payload);
+
+    /**
+     * Feed recorded capture through the update decode and dispatch path.
+     * Blocks until all replayed updates are handled. Update offset of the bot is not changed,
+     * so replay may run while the bot receives live updates. Messages and answers which handlers of
+     * replayed updates send from their own thread are logged and not sent, queries have no answer deadlines
+     * @param capture   Capture file written by recorder (see <code>Telegram::Capture::Path</code>)
+     * @param speed     Replay pacing
+     * @return Replay statistics
+     */
+    ReplayStats replay(const std::filesystem::path& capture, ReplaySpeed speed);
+
     [[nodiscard]] const User& get_profile() const;
     [[nodiscard]] const config::Store& get_config() const;
 
     [[nodiscard]] TimerService& get_timer_service() const;
 
+    /**
+     * Conversation state of chats and users, see <code>Telegram::Sessions</code> configuration
+     */
+    [[nodiscard]] SessionStore& get_session_store() const;
+
+    [[nodiscard]] DispatchMetrics get_dispatch_metrics() const;
+
+    /**
+     * Check if update handlers are saturated.
+     * While saturated, long polling is paused and webhook front-end should reject updates (429/503)
+     */
+    [[nodiscard]] bool is_saturated() const;
+
 private:
     UniquePtr<Impl> _impl;
 };
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/thread_pool.hpp>
+
+#include "tgapi/bot/bot.h"
+
+namespace tg
+{
+
+/**
+ * Runs multiple bots in one process.
+ *
+ * Bots added to the host share one executor (io context with a fixed number of threads),
+ * one pool running callback, pre-checkout and inline query lanes, one thread for query deadlines,
+ * one rest client (and its thread pool and ssl context) and one timer service.
+ * Every bot keeps its own update offset and its own interaction module.
+ */
+class BotHost final {
+
+    class Impl;
+
+public:
+
+    /**
+     * Create host
+     * @param numThreads        Number of threads running shared io context
+     * @param numRestThreads    Number of threads of the shared rest client
+     * @param numQueryThreads   Number of threads running query lanes of all bots
+     */
+    explicit BotHost(std::size_t numThreads = 1, std::size_t numRestThreads = 4, std::size_t numQueryThreads = 2);
+
+    BotHost(const BotHost&) = delete;
+    BotHost(BotHost&&) = delete;
+    BotHost& operator=(const BotHost&) = delete;
+    BotHost& operator=(BotHost&&) = delete;
+    ~BotHost();
+
+    /**
+     * Create bot running on this host
+     * @param config        Bot configuration
+     * @param interaction   Bot interaction module
+     * @return Created bot, owned by the host
+     */
+    TelegramBot& add_bot(config::Store config, UniquePtr<BotInteractionModuleBase> interaction);
+
+    /**
+     * Login all added bots, start long polling and block calling thread until host is drained
+     */
+    void run();
+
+    /**
+     * Drain all bots and join host threads. Must not be called from bot handlers
+     * @param deadline  Time point to give up waiting for bots at
+     * @return True if all bots were drained before deadline
+     */
+    bool drain(std::chrono::steady_clock::time_point deadline);
+
+    /**
+     * Join host threads without draining bots
+     */
+    void shutdown();
+
+    /**
+     * Check that host threads were not joined yet
+     */
+    [[nodiscard]] bool is_running() const;
+
+    [[nodiscard]] boost::asio::io_context& get_io_context() const;
+    [[nodiscard]] boost::asio::thread_pool& get_query_pool() const;
+    [[nodiscard]] boost::asio::thread_pool& get_query_timer_pool() const;
+    [[nodiscard]] rest::Client& get_rest_client() const;
+    [[nodiscard]] TimerService& get_timer_service() const;
+
+private:
+    UniquePtr<Impl> _impl;
+};
+
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+
+#include "tgapi/tgapi.h"
+
+namespace tg
+{
+
+/**
+ * Calendar schedule in cron format: "minute hour day-of-month month day-of-week".
+ *
+ * Fields accept *, numbers, ranges, lists and steps, e.g. "0-59/15 9-18 * * 1-5", day of week 0 and 7 are Sunday.
+ * When both day of month and day of week are restricted, a day matching either of them matches.
+ * Time which is skipped by daylight saving transition never matches, repeated time matches once
+ */
+class CronSchedule final {
+
+    struct Zone;
+
+public:
+
+    /**
+     * @param expression    Cron expression
+     * @param timezone      POSIX timezone with UTC offset positive east of Greenwich (as boost.date_time expects),
+     *                      e.g. "CET+1CEST,M3.5.0,M10.5.0/3", empty for UTC
+     * @throws std::runtime_error if expression or timezone is malformed
+     */
+    explicit CronSchedule(std::string_view expression, std::string_view timezone = {});
+
+    /**
+     * Get next fire time
+     * @param unixMs    Unix time, ms
+     * @return Unix time of the first matching minute after it, nothing if schedule never matches
+     */
+    [[nodiscard]] std::optional<long> next_after(long unixMs) const;
+
+    /**
+     * Get normalized schedule, equal for equivalent expressions in the same timezone
+     */
+    [[nodiscard]] const std::string& key() const { return _key; }
+
+private:
+    [[nodiscard]] bool is_day(unsigned day, unsigned weekday) const;
+
+    std::uint64_t _minutes { 0 };
+    std::uint32_t _hours { 0 };
+    std::uint32_t _days { 0 };
+    std::uint32_t _months { 0 };
+    std::uint32_t _weekdays { 0 };
+    bool _anyDay { false };
+    bool _anyWeekday { false };
+
+    std::string _key;
+    SharedPtr<const Zone> _zone;
+};
+
+}
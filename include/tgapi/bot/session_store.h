@@ -0,0 +1,187 @@
+#pragma once
+
+#include <any>
+#include <charconv>
+#include <chrono>
+#include <cstddef>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+#include "tgapi/tgapi.h"
+
+namespace tg
+{
+
+/**
+ * Session of a user in a chat
+ */
+struct SessionKey {
+    long ChatId { 0 };
+    long UserId { 0 };
+
+    bool operator==(const SessionKey& other) const { return ChatId == other.ChatId && UserId == other.UserId; }
+};
+
+/**
+ * Conversion of session state to text stored in SQLite. State without codec is kept in memory only.
+ * Specialize for own state types:
+ * @code
+ * template<> struct tg::SessionCodec<Wizard> {
+ *     static std::string encode(const Wizard& w);
+ *     static bool decode(std::string_view data, Wizard& w);
+ * };
+ * @endcode
+ */
+template<typename T, typename = void>
+struct SessionCodec;
+
+template<>
+struct SessionCodec<std::string> {
+    static std::string encode(const std::string& value) { return value; }
+    static bool decode(std::string_view data, std::string& value) {
+        value.assign(data);
+        return true;
+    }
+};
+
+template<typename T>
+struct SessionCodec<T, std::enable_if_t<std::is_integral_v<T> || std::is_enum_v<T>>> {
+    using Number = std::conditional_t<std::is_enum_v<T>, std::underlying_type<T>, std::common_type<T>>;
+
+    static std::string encode(const T& value) {
+        char buffer[24];
+        const auto [ptr, ec] = std::to_chars(buffer, buffer + sizeof(buffer), static_cast<typename Number::type>(value));
+        return std::string(buffer, ptr);
+    }
+    static bool decode(std::string_view data, T& value) {
+        typename Number::type number{};
+        const auto [ptr, ec] = std::from_chars(data.data(), data.data() + data.size(), number);
+        value = static_cast<T>(number);
+        return ec == std::errc{} && ptr == data.data() + data.size();
+    }
+};
+
+#pragma region Session details
+
+namespace detail {
+
+    template<typename T, typename = void>
+    struct has_session_codec : std::false_type {};
+
+    template<typename T>
+    struct has_session_codec<T, std::void_t<decltype(SessionCodec<T>::encode(std::declval<const T&>()))>> : std::true_type {};
+
+    using SessionEncoder = std::string (*)(const std::any& value);
+    using SessionDecoder = bool (*)(std::string_view data, std::any& value);
+
+    struct SessionFunctions {
+        SessionEncoder Encode { nullptr };
+        SessionDecoder Decode { nullptr };
+    };
+
+    template<typename T>
+    std::string encode_session(const std::any& value) {
+        return SessionCodec<T>::encode(*std::any_cast<T>(&value));
+    }
+
+    template<typename T>
+    bool decode_session(std::string_view data, std::any& value) {
+        T state{};
+        if (!SessionCodec<T>::decode(data, state)) {
+            return false;
+        }
+        value = std::move(state);
+        return true;
+    }
+}
+
+#pragma endregion // Session details
+
+/**
+ * Typed conversation state per (chat, user), e.g. the step and the answers of a multi-step dialog.
+ * Sessions are kept in a sharded hash map and expire after TTL of inactivity. With a database opened,
+ * changed sessions of types with SessionCodec are written to SQLite in batches by flush() and loaded back on open
+ */
+class SessionStore final {
+public:
+
+    using Clock = std::chrono::steady_clock;
+
+    explicit SessionStore(std::chrono::milliseconds ttl = std::chrono::minutes(30));
+    SessionStore(const SessionStore&) = delete;
+    SessionStore& operator=(const SessionStore&) = delete;
+    ~SessionStore();
+
+    /**
+     * Get state of the session
+     * @return Nothing if there is no session or its state has another type
+     */
+    template<typename T>
+    std::optional<T> get(const SessionKey& key) {
+        std::any value;
+        if (!load(key, value, functions<T>())) {
+            return std::nullopt;
+        }
+        if (auto* state = std::any_cast<T>(&value)) {
+            return std::move(*state);
+        }
+        return std::nullopt;
+    }
+
+    /**
+     * Set state of the session and restart its TTL
+     */
+    template<typename T>
+    void set(const SessionKey& key, T state) {
+        store(key, std::any(std::move(state)), functions<T>());
+    }
+
+    /**
+     * Remove the session
+     * @return False if there is no such session
+     */
+    bool erase(const SessionKey& key);
+
+    /**
+     * Get number of sessions in memory
+     */
+    [[nodiscard]] std::size_t size() const;
+
+    /**
+     * Enable write-behind to SQLite. Sessions which have not expired yet are loaded into memory
+     * @param database  SQLite database path, relative to the executable
+     */
+    void open_store(std::string_view database);
+
+    /**
+     * Write changed sessions to the database in one transaction and remove expired sessions
+     */
+    void flush();
+
+    /**
+     * Remove sessions which were not used for TTL
+     * @return Number of removed sessions
+     */
+    std::size_t evict_expired(Clock::time_point now = Clock::now());
+
+private:
+
+    template<typename T>
+    static detail::SessionFunctions functions() {
+        if constexpr (detail::has_session_codec<T>::value) {
+            return { &detail::encode_session<T>, &detail::decode_session<T> };
+        } else {
+            return {};
+        }
+    }
+
+    bool load(const SessionKey& key, std::any& value, detail::SessionFunctions functions);
+    void store(const SessionKey& key, std::any value, detail::SessionFunctions functions);
+
+    class Impl;
+    UniquePtr<Impl> _impl;
+};
+
+}
@@ -0,0 +1,277 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <boost/asio/any_io_executor.hpp>
+
+#include "tgapi/tgapi.h"
+#include "tgapi/bot/cron_schedule.h"
+
+namespace tg
+{
+
+/**
+ * Duration type of all timer intervals, timers have millisecond resolution
+ */
+using TimerDuration = std::chrono::milliseconds;
+
+/**
+ * Timer handle issued by the service. Handle of deleted or expired timer is rejected,
+ * even if its storage has been reused by another timer
+ */
+class TimerHandle final {
+public:
+
+    TimerHandle() = default;
+    TimerHandle(std::uint32_t index, std::uint32_t generation)
+        : _index{ index }
+        , _generation{ generation }
+    {}
+
+    [[nodiscard]] bool is_valid() const { return _generation != 0; }
+    [[nodiscard]] std::uint32_t index() const { return _index; }
+    [[nodiscard]] std::uint32_t generation() const { return _generation; }
+
+    bool operator==(const TimerHandle& other) const { return _index == other._index && _generation == other._generation; }
+    bool operator!=(const TimerHandle& other) const { return !(*this == other); }
+
+private:
+    std::uint32_t _index { 0 };
+    std::uint32_t _generation { 0 };
+};
+
+/**
+ * Time source of timer service
+ */
+class TimerClock {
+public:
+    using TimePoint = std::chrono::steady_clock::time_point;
+
+    virtual ~TimerClock() = default;
+
+    [[nodiscard]] virtual TimePoint now() const = 0;
+};
+
+/**
+ * Clock which only moves when advanced, for tests and benchmarks
+ */
+class VirtualClock final : public TimerClock {
+public:
+
+    [[nodiscard]] TimePoint now() const override;
+
+    void advance(TimerDuration duration);
+
+private:
+    std::atomic<TimePoint::rep> _now { 0 };
+};
+
+class TimerReply final {
+    void consume_reply();
+public:
+
+    explicit TimerReply(TimerHandle handle);
+
+    TimerReply(const TimerReply&) = delete;
+    TimerReply(TimerReply&&) = delete;
+    TimerReply& operator=(const TimerReply&) = delete;
+    TimerReply& operator=(TimerReply&&) = delete;
+    ~TimerReply() = default;
+
+    void set_delete();
+    void update_interval(TimerDuration interval);
+
+    [[nodiscard]] bool is_delete() const;
+    [[nodiscard]] bool is_interval() const;
+
+    [[nodiscard]] TimerDuration interval() const;
+    [[nodiscard]] TimerHandle handle() const;
+
+private:
+    bool _consumed { false };
+    bool _delete { false };
+    TimerDuration _newInterval { -1 };
+    TimerHandle _handle;
+};
+
+struct TimerSpec {
+    std::function<void(TimerReply&)> Callback;
+    TimerDuration Interval { 0 };
+    bool Looping { false };
+    TimerDuration Slack { 0 };  // how late the timer may fire
+};
+
+struct TimerMetrics {
+    std::size_t Pending { 0 };
+    std::size_t Running { 0 };          // callbacks posted to the executor and not finished yet
+    std::uint64_t Fired { 0 };
+    TimerDuration LastLag { 0 }; // from expiry to callback start
+    TimerDuration MaxLag { 0 };
+    TimerDuration TotalLag { 0 };
+    std::uint64_t Wakeups { 0 };        // timer thread wake-ups
+    std::uint64_t WakeupsPerSecond { 0 };   // wake-ups during the last full second
+};
+
+/**
+ * Tracks timers on a dedicated thread and runs expired callbacks on an executor.
+ *
+ * Timers are measured on the monotonic clock and kept in a hierarchical timing wheel with millisecond ticks,
+ * adding, updating and deleting a timer does not depend on the number of pending timers.
+ * The timer thread never runs callbacks, reply of the callback is applied once it returns;
+ * looping timer is not rescheduled while its callback is running.
+ *
+ * Timer with slack fires at the most aligned tick within [interval, interval + slack], so timers added around
+ * the same time share wake-ups. Callbacks expired at once are dispatched as a single executor job
+ */
+class TimerService final {
+
+    class Impl;
+
+public:
+
+    /**
+     * Create service running callbacks on its own single thread
+     */
+    TimerService();
+
+    /**
+     * Create service running callbacks on the executor
+     * @param executor  Callback executor, must outlive the service or be stopped before it
+     */
+    explicit TimerService(boost::asio::any_io_executor executor);
+
+    /**
+     * Create service driven manually. There is no timer thread, expired timers are fired by poll()
+     * and their callbacks run on the calling thread
+     * @param clock     Time source, usually VirtualClock
+     */
+    explicit TimerService(SharedPtr<TimerClock> clock);
+
+    TimerService(const TimerService&) = delete;
+    TimerService(TimerService&&) = delete;
+    TimerService& operator=(const TimerService&) = delete;
+    TimerService& operator=(TimerService&&) = delete;
+    ~TimerService();
+
+    using DurableCallback = std::function<void(TimerReply&, std::string_view payload)>;
+    using CronTimerId = std::uint64_t;
+
+    /**
+     * Add timer
+     * @param callback  Timer callback
+     * @param interval  Time until the timer fires
+     * @param looping   Fire repeatedly
+     * @param slack     How late the timer may fire, allows to group it with other timers
+     * @return Timer handle
+     */
+    TimerHandle add_timer(std::function<void(TimerReply&)> callback, TimerDuration interval, bool looping,
+                          TimerDuration slack = TimerDuration(0));
+
+    /**
+     * Set timer interval and restart it
+     * @return False if timer does not exist anymore
+     */
+    bool update_timer(TimerHandle handle, TimerDuration interval);
+
+    /**
+     * @return False if timer does not exist anymore
+     */
+    bool delete_timer(TimerHandle handle);
+
+    /**
+     * Add many timers at once
+     * @return Handles, in order of the specs
+     */
+    std::vector<TimerHandle> add_timers(std::vector<TimerSpec> timers);
+
+    /**
+     * Delete many timers at once
+     * @return Number of deleted timers
+     */
+    std::size_t delete_timers(const std::vector<TimerHandle>& handles);
+
+    /**
+     * Add timer firing on calendar schedule. Timers with equal schedules share a single wheel entry,
+     * its next fire time is computed once per firing for all of them
+     * @param schedule  Calendar schedule
+     * @param callback  Timer callback, TimerReply::set_delete() deletes this timer only, update_interval() is ignored
+     * @return Timer id
+     * @throws std::runtime_error if schedule never fires
+     */
+    CronTimerId add_cron_timer(const CronSchedule& schedule, std::function<void(TimerReply&)> callback);
+
+    /**
+     * @return False if timer does not exist anymore
+     */
+    bool delete_cron_timer(CronTimerId id);
+
+    /**
+     * Register callback of durable timers. Callbacks should be registered before the store is opened
+     * @param name      Callback name, stored with the timer
+     * @param callback  Callback receiving the payload of the timer
+     */
+    void register_callback(std::string name, DurableCallback callback);
+
+    /**
+     * Enable durable timers. Timers due within the horizon are loaded into memory,
+     * later timers stay in the database and are paged in as time advances
+     * @param database  SQLite database path, relative to the executable
+     * @param horizon   Time span kept in memory
+     */
+    void open_store(std::string_view database, TimerDuration horizon = std::chrono::hours(1));
+
+    /**
+     * Add timer which survives restart. Timer due while the bot was down fires right after the store is opened
+     * @param callbackName  Name of the registered callback
+     * @param payload       Data passed to the callback
+     * @param key           Timer key in the database, timer with the same key is replaced
+     * @param interval      Time until the timer fires
+     * @param looping       Fire repeatedly
+     */
+    void add_durable_timer(std::string_view callbackName, std::string payload, long key, TimerDuration interval, bool looping);
+
+    /**
+     * Set interval of durable timer and restart it
+     */
+    void update_durable_timer(long key, TimerDuration interval);
+
+    /**
+     * Delete durable timer from memory and from the database
+     */
+    void delete_durable_timer(long key);
+
+    /**
+     * Get number of pending timers
+     */
+    [[nodiscard]] std::size_t size() const;
+
+    [[nodiscard]] TimerMetrics get_metrics() const;
+
+    /**
+     * Fire timers expired by the clock time, manually driven service only
+     * @return Number of fired timers
+     */
+    std::size_t poll();
+
+    /**
+     * Get time until the next timer expires
+     * @return Nothing if there are no timers
+     */
+    [[nodiscard]] std::optional<TimerDuration> next_timeout() const;
+
+    /**
+     * Stop the timer thread and join it. Pending timers are not fired, callbacks which are not started yet are skipped
+     */
+    void shutdown();
+
+private:
+    UniquePtr<Impl> _impl;
+};
+
+}
@@ -0,0 +1,309 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+namespace tg
+{
+
+namespace detail {
+
+inline int lowest_bit(std::uint64_t v) {
+    assert(v != 0);
+#if defined(_MSC_VER)
+    unsigned long index;
+    _BitScanForward64(&index, v);
+    return static_cast<int>(index);
+#else
+    return __builtin_ctzll(v);
+#endif
+}
+
+inline int highest_bit(std::uint64_t v) {
+    assert(v != 0);
+#if defined(_MSC_VER)
+    unsigned long index;
+    _BitScanReverse64(&index, v);
+    return static_cast<int>(index);
+#else
+    return 63 - __builtin_clzll(v);
+#endif
+}
+
+inline std::uint64_t rotate_right(std::uint64_t v, unsigned shift) {
+    shift &= 63;
+    return shift == 0 ? v : (v >> shift) | (v << (64 - shift));
+}
+
+}
+
+/**
+ * Hierarchical timing wheel.
+ *
+ * Seven levels of 64 slots, a slot of level N spans 64^N ticks, so the wheel covers 2^42 ticks ahead.
+ * Entries live in a slab and are linked into slots intrusively, insert, cancel and reschedule are O(1).
+ * Non-empty slots of every level are tracked in a bitmap, so the next expiration is found without scanning slots
+ * and advancing over idle periods costs nothing.
+ *
+ * @tparam T Entry payload, must be default constructible
+ */
+template<typename T>
+class TimingWheel final {
+public:
+
+    using Tick = std::uint64_t;
+    using Index = std::uint32_t;
+
+    static constexpr std::size_t LEVELS = 7;
+    static constexpr std::size_t SLOTS = 64;
+    static constexpr unsigned SLOT_BITS = 6;
+    static constexpr Tick MAX_DELAY = (Tick{ 1 } << (SLOT_BITS * LEVELS)) - 1;
+    static constexpr Index NIL = ~Index{ 0 };
+
+private:
+
+    struct Node {
+        T Value {};
+        Tick Expiry { 0 };
+        Index Prev { NIL };
+        Index Next { NIL };
+        std::uint32_t Generation { 1 };
+        std::uint8_t Level { 0 };
+        std::uint8_t Slot { 0 };
+        bool Linked { false };
+        bool Used { false };
+    };
+
+    struct Expiration {
+        std::size_t Level;
+        std::size_t Slot;
+        Tick Deadline;
+    };
+
+    static constexpr Tick slot_range(std::size_t level) { return Tick{ 1 } << (SLOT_BITS * level); }
+    static constexpr Tick level_range(std::size_t level) { return Tick{ 1 } << (SLOT_BITS * (level + 1)); }
+
+    Index allocate() {
+        Index index;
+        if (_freeHead != NIL) {
+            index = _freeHead;
+            _freeHead = _nodes[index].Next;
+        } else {
+            index = static_cast<Index>(_nodes.size());
+            _nodes.emplace_back();
+        }
+        Node& n = _nodes[index];
+        n.Next = n.Prev = NIL;
+        n.Used = true;
+        ++_size;
+        return index;
+    }
+
+    void link(Index index) {
+        Node& n = _nodes[index];
+
+        // entry which is already due fires on the next tick
+        n.Expiry = std::max(n.Expiry, _elapsed + 1);
+        n.Expiry = std::min(n.Expiry, _elapsed + MAX_DELAY);
+
+        const std::size_t level = std::min<std::size_t>(
+            detail::highest_bit((_elapsed ^ n.Expiry) | (SLOTS - 1)) / SLOT_BITS, LEVELS - 1);
+        const std::size_t slot = static_cast<std::size_t>((n.Expiry >> (SLOT_BITS * level)) & (SLOTS - 1));
+
+        Index& head = _slots[level][slot];
+        n.Level = static_cast<std::uint8_t>(level);
+        n.Slot = static_cast<std::uint8_t>(slot);
+        n.Prev = NIL;
+        n.Next = head;
+        if (head != NIL) {
+            _nodes[head].Prev = index;
+        }
+        head = index;
+        n.Linked = true;
+        _occupied[level] |= std::uint64_t{ 1 } << slot;
+    }
+
+    void unlink(Index index) {
+        Node& n = _nodes[index];
+        if (!n.Linked) {
+            return;
+        }
+
+        if (n.Prev != NIL) {
+            _nodes[n.Prev].Next = n.Next;
+        } else {
+            _slots[n.Level][n.Slot] = n.Next;
+        }
+        if (n.Next != NIL) {
+            _nodes[n.Next].Prev = n.Prev;
+        }
+        if (_slots[n.Level][n.Slot] == NIL) {
+            _occupied[n.Level] &= ~(std::uint64_t{ 1 } << n.Slot);
+        }
+        n.Prev = n.Next = NIL;
+        n.Linked = false;
+    }
+
+    [[nodiscard]] std::optional<Expiration> next_expiration() const {
+        for (std::size_t level = 0; level < LEVELS; ++level) {
+            if (_occupied[level] == 0) {
+                continue;
+            }
+
+            // occupied slots always follow the current one, except for the wrapped entries of the top level
+            const auto from = static_cast<unsigned>(((_elapsed >> (SLOT_BITS * level)) + 1) & (SLOTS - 1));
+            const auto slot = (detail::lowest_bit(detail::rotate_right(_occupied[level], from)) + from) % SLOTS;
+
+            const Tick levelStart = _elapsed & ~(level_range(level) - 1);
+            Tick deadline = levelStart + slot * slot_range(level);
+            if (deadline <= _elapsed) {
+                // only entries beyond the top level wrap around
+                deadline += level_range(level);
+            }
+            return Expiration{ level, slot, deadline };
+        }
+        return std::nullopt;
+    }
+
+public:
+
+    TimingWheel() {
+        for (auto& level : _slots) {
+            level.fill(NIL);
+        }
+    }
+
+    TimingWheel(const TimingWheel&) = delete;
+    TimingWheel& operator=(const TimingWheel&) = delete;
+    ~TimingWheel() = default;
+
+    /**
+     * Schedule new entry
+     * @param expiry    Tick to expire at
+     * @param value     Entry payload
+     * @return Entry index
+     */
+    Index schedule(Tick expiry, T value) {
+        const Index index = allocate();
+        Node& n = _nodes[index];
+        n.Value = std::move(value);
+        n.Expiry = expiry;
+        link(index);
+        return index;
+    }
+
+    /**
+     * Move entry to another tick. Expired entry is scheduled again
+     */
+    void reschedule(Index index, Tick expiry) {
+        assert(_nodes[index].Used);
+        unlink(index);
+        _nodes[index].Expiry = expiry;
+        link(index);
+    }
+
+    /**
+     * Remove entry and release its index
+     * @return Entry payload
+     */
+    T release(Index index) {
+        assert(_nodes[index].Used);
+        unlink(index);
+
+        Node& n = _nodes[index];
+        T value = std::move(n.Value);
+        n.Value = T{};
+        n.Used = false;
+        // stale handles of released entry never match again (generation 0 is reserved for invalid handles)
+        if (++n.Generation == 0) {
+            n.Generation = 1;
+        }
+        n.Next = _freeHead;
+        _freeHead = index;
+        --_size;
+        return value;
+    }
+
+    [[nodiscard]] T& get(Index index) { return _nodes[index].Value; }
+    [[nodiscard]] const T& get(Index index) const { return _nodes[index].Value; }
+    [[nodiscard]] Tick expiry(Index index) const { return _nodes[index].Expiry; }
+    [[nodiscard]] bool is_scheduled(Index index) const { return index < _nodes.size() && _nodes[index].Linked; }
+    [[nodiscard]] bool is_used(Index index) const { return index < _nodes.size() && _nodes[index].Used; }
+    [[nodiscard]] std::uint32_t generation(Index index) const { return _nodes[index].Generation; }
+
+    /**
+     * Check if entry is in use and has not been released since the generation was obtained
+     */
+    [[nodiscard]] bool is_current(Index index, std::uint32_t generation) const {
+        return is_used(index) && _nodes[index].Generation == generation;
+    }
+
+    /**
+     * Advance wheel time, entries which expire up to the tick are unlinked (but not released)
+     * @param now           Current tick
+     * @param [out] expired Indices of expired entries, in expiration order
+     */
+    void advance(Tick now, std::vector<Index>& expired) {
+        while (auto next = next_expiration()) {
+            if (next->Deadline > now) {
+                break;
+            }
+
+            _elapsed = next->Deadline;
+
+            Index index = _slots[next->Level][next->Slot];
+            _slots[next->Level][next->Slot] = NIL;
+            _occupied[next->Level] &= ~(std::uint64_t{ 1 } << next->Slot);
+
+            while (index != NIL) {
+                Node& n = _nodes[index];
+                const Index nextIndex = n.Next;
+                n.Prev = n.Next = NIL;
+                n.Linked = false;
+
+                if (n.Expiry <= _elapsed) {
+                    expired.push_back(index);
+                } else {
+                    // cascade to a lower level
+                    link(index);
+                }
+                index = nextIndex;
+            }
+        }
+
+        _elapsed = std::max(_elapsed, now);
+    }
+
+    /**
+     * Get tick of the next expiration
+     * @return Nothing if wheel is empty
+     */
+    [[nodiscard]] std::optional<Tick> next_deadline() const {
+        if (auto next = next_expiration()) {
+            return next->Deadline;
+        }
+        return std::nullopt;
+    }
+
+    [[nodiscard]] Tick elapsed() const { return _elapsed; }
+    [[nodiscard]] std::size_t size() const { return _size; }
+
+private:
+    std::vector<Node> _nodes;
+    Index _freeHead { NIL };
+    std::size_t _size { 0 };
+
+    std::array<std::array<Index, SLOTS>, LEVELS> _slots;
+    std::array<std::uint64_t, LEVELS> _occupied {};
+    Tick _elapsed { 0 };
+};
+
+}
@@ -0,0 +1,191 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <vector>
+
+#include <boost/asio/any_io_executor.hpp>
+
+#include "tgapi/types/api_types.h"
+
+namespace tg
+{
+
+/**
+ * Class of the received update, used for load shedding and lane selection
+ */
+enum class UpdateClass {
+    COMMAND,
+    MESSAGE,
+    CALLBACK_QUERY,
+    PRE_CHECKOUT_QUERY,
+    INLINE_QUERY,
+};
+
+/**
+ * Dispatch lanes. Every lane has its own queue and worker budget,
+ * so latency-critical updates never wait behind ordinary messages
+ */
+enum class DispatchLane {
+    DEFAULT,            // commands and plain messages
+    CALLBACK_QUERY,
+    PRE_CHECKOUT_QUERY,
+    INLINE_QUERY,
+
+    COUNT
+};
+
+constexpr DispatchLane lane_of(UpdateClass cls) {
+    switch(cls) {
+        case UpdateClass::CALLBACK_QUERY:       return DispatchLane::CALLBACK_QUERY;
+        case UpdateClass::PRE_CHECKOUT_QUERY:   return DispatchLane::PRE_CHECKOUT_QUERY;
+        case UpdateClass::INLINE_QUERY:         return DispatchLane::INLINE_QUERY;
+        default:                                return DispatchLane::DEFAULT;
+    }
+}
+
+/**
+ * What to do with plain messages when handlers are saturated
+ */
+enum class SheddingPolicy {
+    NONE,   // queue everything
+    DROP,   // drop plain messages
+    DEFER,  // keep plain messages aside until queue drops below low watermark
+};
+
+struct DispatcherOptions {
+    std::size_t HighWatermark { 1000 };
+    std::size_t LowWatermark { 500 };
+    std::size_t Workers { 1 };
+    std::size_t CallbackQueryWorkers { 1 };
+    std::size_t PreCheckoutQueryWorkers { 1 };
+    std::size_t InlineQueryWorkers { 1 };
+    SheddingPolicy Shedding { SheddingPolicy::NONE };
+};
+
+struct LaneMetrics {
+    std::size_t QueueDepth { 0 };
+    std::size_t Running { 0 };
+    std::uint64_t Processed { 0 };
+    std::chrono::microseconds TotalWait { 0 };      // from receive to handler start
+    std::chrono::microseconds TotalLatency { 0 };   // from receive to handler end
+    std::chrono::microseconds MaxLatency { 0 };
+};
+
+struct DispatchMetrics {
+    std::size_t QueueDepth { 0 };
+    std::size_t DeferredDepth { 0 };
+    std::size_t Running { 0 };
+    std::uint64_t Processed { 0 };
+    std::uint64_t Shed { 0 };
+    std::uint64_t Deferred { 0 };
+    std::uint64_t Pauses { 0 };
+    std::chrono::milliseconds PausedTime { 0 };
+    std::array<LaneMetrics, static_cast<std::size_t>(DispatchLane::COUNT)> Lanes;
+};
+
+/**
+ * Bounded inbound queue of updates.
+ *
+ * Default lane is handled on the executor, priority lanes on their own executor, so that slow message handlers
+ * do not hold up queries. Every lane runs at most its worker budget of jobs at once.
+ * Once the number of queued and running updates of the default lane reaches high watermark, the dispatcher
+ * is paused (ingestion should stop) until it drops to low watermark. Priority lanes are never shed.
+ */
+class UpdateDispatcher final {
+
+    using Clock = std::chrono::steady_clock;
+
+    struct Job {
+        BotUpdate Update;
+        UpdateClass Class;
+        Clock::time_point ReceivedAt;
+        bool Replayed;
+    };
+
+    struct Lane {
+        std::deque<Job> Queue;
+        std::size_t Workers { 1 };
+        std::size_t Running { 0 };
+        LaneMetrics Metrics;
+    };
+
+    void start_workers(std::unique_lock<std::mutex>& lock);
+    void run_next(DispatchLane lane);
+    [[nodiscard]] Lane& lane(DispatchLane l) { return _lanes[static_cast<std::size_t>(l)]; }
+    [[nodiscard]] const Lane& lane(DispatchLane l) const { return _lanes[static_cast<std::size_t>(l)]; }
+    [[nodiscard]] std::size_t active() const;
+
+public:
+
+    using Handler = std::function<void(BotUpdate&, UpdateClass, bool replayed)>;
+
+    /**
+     * @param executor          Executor of the default lane
+     * @param priorityExecutor  Executor of callback, pre-checkout and inline query lanes
+     * @param options           Watermarks, worker budgets and shedding policy
+     * @param handler           Update handler
+     */
+    UpdateDispatcher(boost::asio::any_io_executor executor, boost::asio::any_io_executor priorityExecutor,
+                     DispatcherOptions options, Handler handler);
+
+    UpdateDispatcher(const UpdateDispatcher&) = delete;
+    UpdateDispatcher(UpdateDispatcher&&) = delete;
+    UpdateDispatcher& operator=(const UpdateDispatcher&) = delete;
+    UpdateDispatcher& operator=(UpdateDispatcher&&) = delete;
+    ~UpdateDispatcher() = default;
+
+    /**
+     * Queue update for handling
+     * @param update    Received update
+     * @param cls       Update class
+     * @param replayed  Update comes from a capture, passed to the handler
+     * @return False if update was shed
+     */
+    bool push(BotUpdate update, UpdateClass cls, bool replayed = false);
+
+    /**
+     * Set callback invoked once dispatcher leaves paused state
+     */
+    void set_resume_callback(std::function<void()> cb);
+
+    /**
+     * Stop handling updates. Queued updates are discarded, running handlers are not interrupted
+     * @return Id of the oldest update which was not handled
+     */
+    std::optional<long> close();
+
+    [[nodiscard]] bool is_paused() const;
+
+    /**
+     * Check that nothing is queued and no worker touches the dispatcher or runs the resume callback
+     */
+    [[nodiscard]] bool is_idle() const;
+    [[nodiscard]] DispatchMetrics get_metrics() const;
+
+private:
+    boost::asio::any_io_executor _executor;
+    boost::asio::any_io_executor _priorityExecutor;
+    DispatcherOptions _options;
+    Handler _handler;
+    std::function<void()> _onResume;
+
+    mutable std::mutex _mutex;
+    std::array<Lane, static_cast<std::size_t>(DispatchLane::COUNT)> _lanes;
+    std::deque<Job> _deferred;
+    std::vector<long> _runningIds;
+    std::atomic<int> _finishing { 0 };  // workers past their handler which still use the dispatcher
+
+    bool _paused { false };
+    bool _closed { false };
+    Clock::time_point _pausedAt;
+
+    DispatchMetrics _metrics;
+};
+
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <string_view>
+
+namespace tg
+{
+
+/**
+ * Capture file format:
+ *
+ *  header:  "TGCAP" + format version byte
+ *  record:  kind (1 byte), receive time in microseconds since epoch (8 bytes LE),
+ *           payload length (4 bytes LE), payload bytes
+ */
+struct CaptureRecord {
+    enum Kind : std::uint8_t {
+        GET_UPDATES = 0,    // getUpdates response
+        WEBHOOK = 1,        // single webhook update
+    };
+
+    Kind Type { GET_UPDATES };
+    std::chrono::microseconds ReceivedAt { 0 };
+    std::string Payload;
+};
+
+/**
+ * Appends raw update payloads to the capture file
+ */
+class UpdateRecorder final {
+public:
+
+    explicit UpdateRecorder(const std::filesystem::path& path);
+
+    UpdateRecorder(const UpdateRecorder&) = delete;
+    UpdateRecorder& operator=(const UpdateRecorder&) = delete;
+    ~UpdateRecorder() = default;
+
+    /**
+     * Append payload to the capture, stamped with current time
+     * @param kind      Payload kind
+     * @param payload   Raw payload
+     */
+    void append(CaptureRecord::Kind kind, std::string_view payload);
+
+private:
+    std::mutex _mutex;
+    std::ofstream _ofs;
+};
+
+/**
+ * Reads records of the capture file sequentially
+ */
+class CaptureReader final {
+public:
+
+    explicit CaptureReader(const std::filesystem::path& path);
+
+    CaptureReader(const CaptureReader&) = delete;
+    CaptureReader& operator=(const CaptureReader&) = delete;
+    ~CaptureReader() = default;
+
+    /**
+     * Read next record
+     * @param [out] record  Read record
+     * @return False if there are no records left
+     */
+    bool next(CaptureRecord& record);
+
+private:
+    std::ifstream _ifs;
+};
+
+enum class ReplaySpeed {
+    AS_FAST_AS_POSSIBLE,
+    ORIGINAL,
+};
+
+struct ReplayStats {
+    std::size_t Records { 0 };
+    std::size_t Updates { 0 };
+    std::size_t Suppressed { 0 };   // requests of handlers which were not sent to Telegram
+    std::chrono::milliseconds Elapsed { 0 };
+};
+
+}
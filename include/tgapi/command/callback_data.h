@@ -0,0 +1,227 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+#include "tgapi/types/api_types.h"
+
+namespace tg {
+
+#pragma region Callback data details
+
+namespace detail {
+
+    // callback data must be valid UTF-8, so packed values are written with url-safe base64 digits
+    inline constexpr std::string_view CALLBACK_DIGITS = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789-_";
+    inline constexpr std::size_t MAX_CALLBACK_DATA = 64;
+    inline constexpr std::size_t CALLBACK_ROUTE_BITS = 12;
+    inline constexpr std::size_t CALLBACK_ROUTES = std::size_t{ 1 } << CALLBACK_ROUTE_BITS;
+
+    constexpr int callback_digit_value(char ch) {
+        if (ch >= 'A' && ch <= 'Z') return ch - 'A';
+        if (ch >= 'a' && ch <= 'z') return ch - 'a' + 26;
+        if (ch >= '0' && ch <= '9') return ch - '0' + 52;
+        if (ch == '-') return 62;
+        if (ch == '_') return 63;
+        return -1;
+    }
+
+    /**
+     * Route id of the name, FNV-1a folded to CALLBACK_ROUTE_BITS.
+     * Id depends only on the name, so buttons of old messages still work after restart
+     */
+    constexpr std::uint16_t callback_route_id(std::string_view name) {
+        std::uint32_t hash = 2166136261u;
+        for (char ch : name) {
+            hash = (hash ^ static_cast<unsigned char>(ch)) * 16777619u;
+        }
+        return static_cast<std::uint16_t>((hash ^ (hash >> CALLBACK_ROUTE_BITS) ^ (hash >> 24)) & (CALLBACK_ROUTES - 1));
+    }
+
+    /**
+     * Read route id from the first two characters of callback data
+     * @return CALLBACK_ROUTES if data is not made by CallbackRoute
+     */
+    constexpr std::size_t read_callback_route(std::string_view data) {
+        if (data.size() < 2) {
+            return CALLBACK_ROUTES;
+        }
+        const int hi = callback_digit_value(data[0]);
+        const int lo = callback_digit_value(data[1]);
+        return hi < 0 || lo < 0 ? CALLBACK_ROUTES : static_cast<std::size_t>(hi << 6 | lo);
+    }
+
+    inline void write_callback_value(std::string& out, bool value) {
+        out.push_back(CALLBACK_DIGITS[value ? 1 : 0]);
+    }
+
+    template<typename T, std::enable_if_t<std::is_integral_v<T> && !std::is_same_v<T, bool>, void**> = nullptr>
+    void write_callback_value(std::string& out, T value) {
+        // zigzag keeps small negative numbers short
+        std::uint64_t bits = static_cast<std::uint64_t>(value);
+        if constexpr (std::is_signed_v<T>) {
+            bits = (bits << 1) ^ static_cast<std::uint64_t>(static_cast<std::int64_t>(value) >> 63);
+        }
+
+        char digits[11];
+        std::size_t n = 0;
+        for (; bits != 0; bits >>= 6) {
+            digits[n++] = CALLBACK_DIGITS[bits & 63];
+        }
+        out.push_back(CALLBACK_DIGITS[n]);
+        out.append(digits, n);
+    }
+
+    inline void write_callback_value(std::string& out, std::string_view value) {
+        if (value.size() >= CALLBACK_DIGITS.size()) {
+            throw std::runtime_error("callback data is longer than 64 bytes");
+        }
+        out.push_back(CALLBACK_DIGITS[value.size()]);
+        out.append(value);
+    }
+
+    inline bool read_callback_length(std::string_view& in, std::size_t& length) {
+        if (in.empty()) {
+            return false;
+        }
+        const int value = callback_digit_value(in.front());
+        if (value < 0 || static_cast<std::size_t>(value) > in.size() - 1) {
+            return false;
+        }
+        length = static_cast<std::size_t>(value);
+        in.remove_prefix(1);
+        return true;
+    }
+
+    inline bool read_callback_value(std::string_view& in, bool& out) {
+        if (in.empty() || (in.front() != CALLBACK_DIGITS[0] && in.front() != CALLBACK_DIGITS[1])) {
+            return false;
+        }
+        out = in.front() == CALLBACK_DIGITS[1];
+        in.remove_prefix(1);
+        return true;
+    }
+
+    template<typename T, std::enable_if_t<std::is_integral_v<T> && !std::is_same_v<T, bool>, void**> = nullptr>
+    bool read_callback_value(std::string_view& in, T& out) {
+        std::size_t n = 0;
+        if (!read_callback_length(in, n) || n > 11) {
+            return false;
+        }
+
+        std::uint64_t bits = 0;
+        for (std::size_t i = n; i-- > 0;) {
+            const int digit = callback_digit_value(in[i]);
+            if (digit < 0) {
+                return false;
+            }
+            bits = bits << 6 | static_cast<std::uint64_t>(digit);
+        }
+        in.remove_prefix(n);
+
+        if constexpr (std::is_signed_v<T>) {
+            bits = (bits >> 1) ^ (~(bits & 1) + 1);
+        }
+        out = static_cast<T>(bits);
+        return static_cast<std::uint64_t>(out) == bits;
+    }
+
+    inline bool read_callback_value(std::string_view& in, std::string_view& out) {
+        std::size_t n = 0;
+        if (!read_callback_length(in, n)) {
+            return false;
+        }
+        out = in.substr(0, n);
+        in.remove_prefix(n);
+        return true;
+    }
+
+    inline bool read_callback_value(std::string_view& in, std::string& out) {
+        std::string_view view;
+        if (!read_callback_value(in, view)) {
+            return false;
+        }
+        out.assign(view);
+        return true;
+    }
+}
+
+#pragma endregion // Callback data details
+
+/**
+ * Typed route of inline keyboard buttons. Callback data of a button is two characters of route id, which is derived
+ * from the route name, followed by packed arguments. Supported argument types are integers, bool,
+ * <code>std::string</code> and <code>std::string_view</code>; data must fit into 64 bytes:
+ * @code
+ * inline constexpr tg::CallbackRoute<long, bool> Vote{ "vote" };
+ *
+ * markup.InlineKeyboard.push_back({ Vote.button("Yes", pollId, true), Vote.button("No", pollId, false) });
+ * add_callback(Vote, &MyModule::on_vote); // void on_vote(const tg::CallbackQueryInteraction&, long poll, bool yes)
+ * @endcode
+ */
+template<typename... Args>
+class CallbackRoute final {
+public:
+
+    constexpr explicit CallbackRoute(std::string_view name)
+        : _name{ name }
+        , _id{ detail::callback_route_id(name) }
+    {}
+
+    [[nodiscard]] constexpr std::string_view name() const { return _name; }
+    [[nodiscard]] constexpr std::uint16_t id() const { return _id; }
+
+    /**
+     * Pack arguments into callback data
+     * @throws std::runtime_error if data is longer than 64 bytes
+     */
+    [[nodiscard]] std::string encode(const Args&... args) const {
+        std::string data;
+        data.reserve(detail::MAX_CALLBACK_DATA);
+        data.push_back(detail::CALLBACK_DIGITS[_id >> 6]);
+        data.push_back(detail::CALLBACK_DIGITS[_id & 63]);
+        (detail::write_callback_value(data, args), ...);
+
+        if (data.size() > detail::MAX_CALLBACK_DATA) {
+            throw std::runtime_error("callback data is longer than 64 bytes");
+        }
+        return data;
+    }
+
+    /**
+     * Make button which sends the arguments to this route
+     */
+    [[nodiscard]] InlineKeyboardButton button(std::string text, const Args&... args) const {
+        InlineKeyboardButton b;
+        b.Text = std::move(text);
+        b.CallbackData = encode(args...);
+        return b;
+    }
+
+    /**
+     * Unpack arguments of callback data, string views point into the data
+     * @return False if data is not made by this route
+     */
+    [[nodiscard]] bool decode(std::string_view data, std::tuple<Args...>& args) const {
+        if (detail::read_callback_route(data) != _id) {
+            return false;
+        }
+        data.remove_prefix(2);
+        const bool ok = std::apply([&data](auto&... values) {
+            return (detail::read_callback_value(data, values) && ...);
+        }, args);
+        return ok && data.empty();
+    }
+
+private:
+    std::string_view _name;
+    std::uint16_t _id;
+};
+
+}
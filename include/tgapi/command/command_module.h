@@ -1,6 +1,21 @@
 #pragma once
 
+#include <atomic>
+#include <functional>
+#include <initializer_list>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <string_view>
+#include <vector>
+
+#include "tgapi/bot/session_store.h"
+#include "tgapi/command/callback_data.h"
+#include "tgapi/command/command_table.h"
 #include "tgapi/command/function.h"
+#include "tgapi/command/inline_query.h"
+#include "tgapi/command/middleware.h"
+#include "tgapi/command/trigger_matcher.h"
 #include "tgapi/types/api_types.h"
 
 #include "log/types.h"
@@ -8,9 +23,24 @@
 namespace tg {
 
 class TelegramBot;
+class TimerReply;
+
+/**
+ * Command of a message, views into the message text
+ */
+struct CommandView {
+    std::string_view Name;      // without leading slash
+    std::string_view Mention;   // bot user name after '@', empty if command has no mention
+    std::string_view Args;      // text after the command
+};
 
-bool parse_command_from_text(const Message& m, const TelegramBot& bot, std::string& command, std::string& args);
-bool parse_command_arguments(const function::FunctionBase& func, std::string_view arguments, function::ArgumentList& args);
+/**
+ * Extract command from message text. Only the span of the leading bot command entity is looked at
+ * @param m         Message
+ * @param botName   User name of the bot, command mentioning another bot (<code>/cmd@other_bot</code>) is ignored
+ * @return Nothing if message does not start with a command for this bot
+ */
+std::optional<CommandView> parse_command_from_text(const Message& m, std::string_view botName);
 
 class BotInteraction {
 
@@ -33,15 +63,188 @@ public:
 
     [[maybe_unused]] Future<Result<Message>> reply_async(
             std::string_view text = "",
-            const MessageEntities* entities = nullptr
+            const MessageEntities* entities = nullptr,
+            const InlineKeyboardMarkup* markup = nullptr
     ) const;
 
+    /**
+     * Session of the sender in this chat
+     */
+    [[nodiscard]] SessionKey get_session_key() const;
+    [[nodiscard]] SessionStore& get_sessions() const;
+
+    /**
+     * Get conversation state of the sender in this chat
+     * @return Nothing if there is no state of this type
+     */
+    template<typename T>
+    [[nodiscard]] std::optional<T> get_session() const { return get_sessions().get<T>(get_session_key()); }
+
+    template<typename T>
+    void set_session(T state) const { get_sessions().set(get_session_key(), std::move(state)); }
+
+    [[maybe_unused]] bool clear_session() const { return get_sessions().erase(get_session_key()); }
+
 private:
     TelegramBot& _bot;
     Message& _m;
 };
 
+/**
+ * Received callback query (inline keyboard button press).
+ * The query must be answered, otherwise the client keeps showing progress indicator;
+ * unanswered queries are answered by the bot once handler returns or answer deadline expires
+ */
+class CallbackQueryInteraction {
+
+public:
+
+    CallbackQueryInteraction(TelegramBot& bot, const CallbackQuery& query, SharedPtr<std::atomic<bool>> answered)
+        : _bot{ bot }
+        , _query{ query }
+        , _answered{ std::move(answered) }
+    {}
+
+    CallbackQueryInteraction() = delete;
+    CallbackQueryInteraction(const CallbackQueryInteraction&) = delete;
+    CallbackQueryInteraction(CallbackQueryInteraction&&) = delete;
+    CallbackQueryInteraction& operator=(const CallbackQueryInteraction&) = delete;
+    CallbackQueryInteraction& operator=(CallbackQueryInteraction&&) = delete;
+
+    [[nodiscard]] const CallbackQuery& get_query() const { return _query; }
+    [[nodiscard]] TelegramBot& get_bot() const { return _bot; }
+    [[nodiscard]] bool is_answered() const { return *_answered; }
+
+    /**
+     * Answer the query. Only the first answer is sent
+     * @param text          Notification text, empty to send no notification
+     * @param showAlert     Show alert instead of notification
+     * @return Empty future if query has already been answered
+     */
+    [[maybe_unused]] Future<Result<bool>> answer_async(std::string_view text = "", bool showAlert = false) const;
+
+    /**
+     * Session of the user who pressed the button, in the chat of the message with the button
+     */
+    [[nodiscard]] SessionKey get_session_key() const;
+
+private:
+    TelegramBot& _bot;
+    const CallbackQuery& _query;
+    SharedPtr<std::atomic<bool>> _answered;
+};
+
+/**
+ * Received inline query. Superseded queries of the same user are dropped by the bot before they reach the module
+ */
+class InlineQueryInteraction {
+
+public:
+
+    InlineQueryInteraction(TelegramBot& bot, const InlineQuery& query)
+        : _bot{ bot }
+        , _query{ query }
+    {}
+
+    InlineQueryInteraction() = delete;
+    InlineQueryInteraction(const InlineQueryInteraction&) = delete;
+    InlineQueryInteraction(InlineQueryInteraction&&) = delete;
+    InlineQueryInteraction& operator=(const InlineQueryInteraction&) = delete;
+    InlineQueryInteraction& operator=(InlineQueryInteraction&&) = delete;
+
+    [[nodiscard]] const InlineQuery& get_query() const { return _query; }
+    [[nodiscard]] TelegramBot& get_bot() const { return _bot; }
+
+    /**
+     * Answer the query
+     * @param results       Results of the page
+     * @param nextOffset    Offset the client sends to get the next page, empty if there are no more results
+     * @param cacheTime     Seconds Telegram may cache the answer
+     */
+    [[maybe_unused]] Future<Result<bool>> answer_async(std::vector<InlineQueryResult> results,
+                                                       std::string nextOffset = "", int cacheTime = 300) const;
+
+private:
+    TelegramBot& _bot;
+    const InlineQuery& _query;
+};
+
+/**
+ * Received pre-checkout query. Telegram cancels the payment unless it is answered within 10 seconds;
+ * unanswered queries are declined by the bot once handler returns or answer deadline expires
+ */
+class PreCheckoutQueryInteraction {
+
+public:
+
+    PreCheckoutQueryInteraction(TelegramBot& bot, const PreCheckoutQuery& query, SharedPtr<std::atomic<bool>> answered)
+        : _bot{ bot }
+        , _query{ query }
+        , _answered{ std::move(answered) }
+    {}
+
+    PreCheckoutQueryInteraction() = delete;
+    PreCheckoutQueryInteraction(const PreCheckoutQueryInteraction&) = delete;
+    PreCheckoutQueryInteraction(PreCheckoutQueryInteraction&&) = delete;
+    PreCheckoutQueryInteraction& operator=(const PreCheckoutQueryInteraction&) = delete;
+    PreCheckoutQueryInteraction& operator=(PreCheckoutQueryInteraction&&) = delete;
+
+    [[nodiscard]] const PreCheckoutQuery& get_query() const { return _query; }
+    [[nodiscard]] TelegramBot& get_bot() const { return _bot; }
+    [[nodiscard]] bool is_answered() const { return *_answered; }
+
+    /**
+     * Answer the query. Only the first answer is sent
+     * @param ok            True to proceed with the payment
+     * @param errorMessage  Reason shown to the user if payment is declined
+     * @return Empty future if query has already been answered
+     */
+    [[maybe_unused]] Future<Result<bool>> answer_async(bool ok, std::string_view errorMessage = "") const;
+
+private:
+    TelegramBot& _bot;
+    const PreCheckoutQuery& _query;
+    SharedPtr<std::atomic<bool>> _answered;
+};
+
 class BotInteractionModuleBase {
+
+    enum class RouteResult {
+        NOT_FOUND,
+        INVALID_ARGUMENTS,
+        INVOKED,
+    };
+
+    using CommandRouter = RouteResult (*)(const void* table, BotInteractionModuleBase& self, const BotInteraction& interaction,
+                                          std::string_view name, std::string_view arguments,
+                                          std::optional<function::PendingResult>& pending);
+
+    using MiddlewareStage = void (*)(BotInteractionModuleBase& self, const MiddlewareContext& context);
+    using MiddlewareRunner = bool (*)(void* chain, const MiddlewareContext& context, BotInteractionModuleBase& self,
+                                      MiddlewareStage stage);
+
+    struct CallbackRouteEntry {
+        std::string Name;
+        // false if data does not match the route arguments
+        std::function<bool(const CallbackQueryInteraction&)> Handler;
+    };
+
+    struct PendingCommand {
+        std::string Name;
+        function::PendingResult Result;
+    };
+
+    /**
+     * Asynchronous handlers which have not completed yet, polled by a timer of the bot.
+     * Shared with the timer, so that it does not outlive the list
+     */
+    struct PendingCommands {
+        std::mutex Mutex;
+        std::vector<PendingCommand> Commands;
+        bool IsPolling { false };
+        mylog::LoggerPtr Logger { nullptr };
+    };
+
 public:
 
     BotInteractionModuleBase();
@@ -49,36 +252,225 @@ public:
     BotInteractionModuleBase& operator=(const BotInteractionModuleBase&) = delete;
     virtual ~BotInteractionModuleBase() = default;
 
-    virtual void execute_interaction(tg::UniquePtr<BotInteraction> interaction);
+    virtual void execute_interaction(const BotInteraction& interaction);
     virtual void post_login(tg::TelegramBot& bot) { }
-    void receive_message(tg::UniquePtr<BotInteraction> interaction);
+    void receive_message(const BotInteraction& interaction);
+    void receive_callback_query(const CallbackQueryInteraction& interaction);
+    void receive_pre_checkout_query(const PreCheckoutQueryInteraction& interaction);
+    void receive_inline_query(const InlineQueryInteraction& interaction);
+
+    /**
+     * Get update types this module has handlers for.
+     * The bot requests only these types from Telegram (<code>allowed_updates</code>)
+     * @return Update type mask
+     */
+    [[nodiscard]] virtual UpdateTypeMask get_update_mask() const { return _updateMask; }
+
+    /**
+     * Check if handlers of this module may run concurrently. Handlers of a module which is not thread safe
+     * are run one at a time, even if the bot handles updates on several workers
+     */
+    [[nodiscard]] virtual bool is_thread_safe() const { return false; }
+
+    /**
+     * Get number of asynchronous handlers which have not completed yet
+     */
+    [[nodiscard]] std::size_t get_pending_count() const;
 
 protected:
 
     mylog::Logger& get_logger() const;
 
-    virtual void on_receive_message() { }
-
-    [[nodiscard]] const BotInteraction& get_current_interaction() {
-        if (!_current) {
-            throw std::runtime_error("interaction is not set");
-        }
-        return *_current;
+    void enable_update_type(int type) {
+        _updateMask |= update_type_bit(type);
     }
 
+    virtual void on_receive_message(const BotInteraction& /*interaction*/) { }
+
+    /**
+     * Add command handler. Handler returning <code>std::future</code> (e.g. of BotInteraction::reply_async()) is
+     * asynchronous: its completion is tracked by the bot timer service without blocking the worker, and only its
+     * synchronous part runs under the module lock. Interaction is valid only until the handler returns.
+     * Deferred future (<code>std::async(std::launch::deferred, ...)</code>) is run by the worker of the update
+     * right after the handler returns, outside the module lock
+     * @param commandName   Command name, without slash
+     * @param func          Handler
+     */
     template<typename Class, typename ReturnType, typename... Args>
     void add_command(std::string commandName, ReturnType (Class::*func)(Args...)) {
         using FuncType = function::Function<ReturnType, Class, Args...>;
 
         auto ptr = make_unique<FuncType>((Class*)this, func);;
         _mapping[std::move(commandName)] = std::move(ptr);
+        enable_update_type(BotUpdate::MESSAGE);
+    }
+
+    /**
+     * Route commands through compile-time table, see tg::make_command_table().
+     * Commands added with add_command() are looked up only if the table has no match
+     * @param table Command table, must outlive the module (usually a constexpr variable)
+     */
+    template<typename Class, std::size_t N>
+    void set_command_table(const CommandTable<Class, N>& table) {
+        _commandTable = &table;
+        _commandRouter = [](const void* t, BotInteractionModuleBase& self, const BotInteraction& interaction,
+                            std::string_view name, std::string_view arguments,
+                            std::optional<function::PendingResult>& pending) {
+            const auto* route = static_cast<const CommandTable<Class, N>*>(t)->find(name);
+            if (route == nullptr) {
+                return RouteResult::NOT_FOUND;
+            }
+            return route->Invoker(static_cast<Class&>(self), interaction, arguments, pending)
+                ? RouteResult::INVOKED
+                : RouteResult::INVALID_ARGUMENTS;
+        };
+        enable_update_type(BotUpdate::MESSAGE);
+    }
+
+    /**
+     * Call handler when plain message contains one of the phrases (case insensitive).
+     * Phrases of all triggers are matched in a single pass over the message, before on_receive_message();
+     * handler is called once per message with the first matching phrase
+     * @param phrases       Phrases
+     * @param func          Handler, receives the matched part of the message text
+     * @param wholeWord     Match only if phrase is not a part of a longer word
+     */
+    template<typename Class>
+    void add_trigger(std::initializer_list<std::string_view> phrases,
+                     void (Class::*func)(const BotInteraction&, std::string_view), bool wholeWord = false) {
+        const std::size_t handler = _triggerHandlers.size();
+        for (auto phrase : phrases) {
+            _triggers.add(phrase, handler, wholeWord);
+        }
+        _triggerHandlers.emplace_back([this, func](const BotInteraction& interaction, std::string_view match) {
+            (static_cast<Class*>(this)->*func)(interaction, match);
+        });
+        _triggersCompiled = false;
+    }
+
+    template<typename Class>
+    void add_trigger(std::string_view phrase, void (Class::*func)(const BotInteraction&, std::string_view),
+                     bool wholeWord = false) {
+        add_trigger({ phrase }, func, wholeWord);
+    }
+
+    /**
+     * Pass commands and plain messages through middleware before they reach handlers, see tg::make_middleware_chain().
+     * Middleware runs before arguments are parsed and outside the module lock, so it must be thread safe.
+     * Empty chain removes the middleware
+     * @param chain Middleware chain
+     */
+    template<typename... Middleware>
+    void set_middleware(MiddlewareChain<Middleware...> chain) {
+        using Chain = MiddlewareChain<Middleware...>;
+
+        if constexpr (Chain::size() == 0) {
+            _middleware.reset();
+            _middlewareRunner = nullptr;
+        } else {
+            _middleware = make_shared<Chain>(std::move(chain));
+            _middlewareRunner = [](void* c, const MiddlewareContext& context, BotInteractionModuleBase& self,
+                                   MiddlewareStage stage) {
+                return static_cast<Chain*>(c)->run(context, [&self, &context, stage] { stage(self, context); });
+            };
+        }
+    }
+
+    template<typename Class>
+    void set_callback_query_handler(void (Class::*func)(const CallbackQueryInteraction&)) {
+        _callbackQueryHandler = [this, func](const CallbackQueryInteraction& interaction) {
+            (static_cast<Class*>(this)->*func)(interaction);
+        };
+        enable_update_type(BotUpdate::CALLBACK_QUERY);
+    }
+
+    /**
+     * Route callback queries of the buttons made by the route to the handler, see tg::CallbackRoute.
+     * Lookup is an array index by route id. Query is answered by the bot once handler returns, unless handler answers it
+     * @param route         Route
+     * @param func          Handler, takes the interaction and the route arguments
+     * @param answerFirst   Answer the query before the handler runs, so that the button stops loading at once
+     */
+    template<typename Class, typename... Args, typename... Params>
+    void add_callback(const CallbackRoute<Args...>& route, void (Class::*func)(const CallbackQueryInteraction&, Params...),
+                      bool answerFirst = false) {
+        static_assert(std::is_same_v<std::tuple<Args...>, std::tuple<function::detail::Bare<Params>...>>,
+                      "handler parameters must match the route arguments");
+
+        add_callback_route(route.id(), route.name(), [this, route, func, answerFirst](const CallbackQueryInteraction& interaction) {
+            std::tuple<Args...> args;
+            if (!route.decode(interaction.get_query().Data, args)) {
+                return false;
+            }
+            if (answerFirst) {
+                interaction.answer_async();
+            }
+            std::apply([this, func, &interaction](auto&... values) {
+                (static_cast<Class*>(this)->*func)(interaction, values...);
+            }, args);
+            return true;
+        });
+        enable_update_type(BotUpdate::CALLBACK_QUERY);
+    }
+
+    /**
+     * Set inline query handler. Handler receives normalized query text and returns all its results; results are cached
+     * by the text (they must not depend on the user) and sent page by page through <code>next_offset</code>,
+     * so handler runs once per distinct query
+     * @param func      Handler
+     * @param options   Page size and cache options
+     */
+    template<typename Class>
+    void set_inline_query_handler(std::vector<InlineQueryResult> (Class::*func)(std::string_view query),
+                                  InlineQueryOptions options = {}) {
+        _inlineQueryHandler = [this, func](std::string_view query) {
+            return (static_cast<Class*>(this)->*func)(query);
+        };
+        _inlineCache = make_unique<InlineResultCache>(options.CacheCapacity, options.CacheTtl);
+        _inlineOptions = options;
+        enable_update_type(BotUpdate::INLINE_QUERY);
+    }
+
+    template<typename Class>
+    void set_pre_checkout_query_handler(void (Class::*func)(const PreCheckoutQueryInteraction&)) {
+        _preCheckoutQueryHandler = [this, func](const PreCheckoutQueryInteraction& interaction) {
+            (static_cast<Class*>(this)->*func)(interaction);
+        };
+        enable_update_type(BotUpdate::PRE_CHECKOUT_QUERY);
     }
 
 
 private:
-    UniquePtr<BotInteraction> _current;
+    [[nodiscard]] std::unique_lock<std::mutex> lock_execution();
+    void run_middleware(const MiddlewareContext& context, MiddlewareStage stage);
+    void dispatch_command(const BotInteraction& interaction, const CommandView& cmd);
+    void dispatch_triggers(const BotInteraction& interaction);
+    void add_callback_route(std::uint16_t id, std::string_view name, std::function<bool(const CallbackQueryInteraction&)> handler);
+    [[nodiscard]] const CallbackRouteEntry* find_callback_route(std::string_view data) const;
+    void track_pending(const BotInteraction& interaction, std::string_view command, function::PendingResult result);
+    static void poll_pending(PendingCommands& pending, TimerReply& reply);
+
+    std::mutex _executionMutex;
     mylog::LoggerPtr _logger;
-    std::unordered_map<std::string, UniquePtr<tg::function::FunctionBase>> _mapping;
+    // plain messages are always delivered to on_receive_message()
+    UpdateTypeMask _updateMask { update_type_bit(BotUpdate::MESSAGE) };
+    std::map<std::string, UniquePtr<tg::function::FunctionBase>, std::less<>> _mapping;
+    const void* _commandTable { nullptr };
+    CommandRouter _commandRouter { nullptr };
+    std::function<void(const CallbackQueryInteraction&)> _callbackQueryHandler;
+    std::vector<CallbackRouteEntry> _callbackRoutes;
+    std::vector<std::uint16_t> _callbackRouteIndex;     // route id -> index in _callbackRoutes + 1, 0 if none
+    std::function<void(const PreCheckoutQueryInteraction&)> _preCheckoutQueryHandler;
+    std::function<std::vector<InlineQueryResult>(std::string_view)> _inlineQueryHandler;
+    UniquePtr<InlineResultCache> _inlineCache;
+    InlineQueryOptions _inlineOptions;
+    SharedPtr<PendingCommands> _pending;
+    SharedPtr<void> _middleware;
+    TriggerMatcher _triggers;
+    std::vector<std::function<void(const BotInteraction&, std::string_view)>> _triggerHandlers;
+    std::mutex _triggersMutex;
+    std::atomic<bool> _triggersCompiled { false };
+    MiddlewareRunner _middlewareRunner { nullptr };
 };
 
 }
\ No newline at end of file
@@ -0,0 +1,161 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <stdexcept>
+#include <string_view>
+
+#include "tgapi/command/function.h"
+
+namespace tg {
+
+#pragma region Command table details
+
+namespace detail {
+
+    constexpr char to_lower_ascii(char ch) {
+        return ch >= 'A' && ch <= 'Z' ? static_cast<char>(ch - 'A' + 'a') : ch;
+    }
+
+    /**
+     * Case insensitive three-way comparison of command names
+     */
+    constexpr int compare_command_names(std::string_view a, std::string_view b) {
+        const std::size_t n = a.size() < b.size() ? a.size() : b.size();
+        for (std::size_t i = 0; i < n; ++i) {
+            const char x = to_lower_ascii(a[i]);
+            const char y = to_lower_ascii(b[i]);
+            if (x != y) {
+                return x < y ? -1 : 1;
+            }
+        }
+        if (a.size() == b.size()) {
+            return 0;
+        }
+        return a.size() < b.size() ? -1 : 1;
+    }
+}
+
+#pragma endregion // Command table details
+
+template<typename Class>
+using CommandInvoker = bool (*)(Class& obj, const BotInteraction& interaction, std::string_view arguments,
+                                std::optional<function::PendingResult>& pending);
+
+/**
+ * Command names and handler, see tg::command()
+ */
+template<typename Class, std::size_t N>
+struct CommandSpec {
+    std::array<std::string_view, N> Names;
+    CommandInvoker<Class> Invoker;
+};
+
+/**
+ * Describe command of a command table
+ * @tparam Func     Handler, member function of the interaction module
+ * @param name      Command name
+ * @param aliases   Other names of the command
+ */
+template<auto Func, typename... Aliases>
+constexpr auto command(std::string_view name, Aliases... aliases) {
+    using Class = typename function::detail::member_class<decltype(Func)>::type;
+
+    return CommandSpec<Class, 1 + sizeof...(Aliases)>{
+        { name, std::string_view(aliases)... },
+        [](Class& obj, const BotInteraction& interaction, std::string_view arguments,
+           std::optional<function::PendingResult>& pending) {
+            return function::invoke(obj, Func, interaction, arguments, pending);
+        }
+    };
+}
+
+/**
+ * Command routing table built at compile time, see tg::make_command_table().
+ * Names are kept sorted, lookup is a case insensitive binary search over string views
+ */
+template<typename Class, std::size_t N>
+class CommandTable final {
+public:
+
+    struct Route {
+        std::string_view Name;
+        CommandInvoker<Class> Invoker { nullptr };
+    };
+
+    constexpr explicit CommandTable(const std::array<Route, N>& routes)
+        : _routes{ routes }
+    {
+        // insertion sort, std::sort is not constexpr in C++17
+        for (std::size_t i = 1; i < N; ++i) {
+            for (std::size_t j = i; j > 0 && detail::compare_command_names(_routes[j].Name, _routes[j - 1].Name) < 0; --j) {
+                const Route tmp = _routes[j];
+                _routes[j] = _routes[j - 1];
+                _routes[j - 1] = tmp;
+            }
+        }
+
+        for (std::size_t i = 0; i < N; ++i) {
+            if (_routes[i].Name.empty()) {
+                throw std::logic_error("command name is empty");
+            }
+            if (i > 0 && detail::compare_command_names(_routes[i].Name, _routes[i - 1].Name) == 0) {
+                throw std::logic_error("command name is not unique");
+            }
+        }
+    }
+
+    /**
+     * Find command by name, case insensitive
+     * @return Nullptr if there is no such command
+     */
+    [[nodiscard]] constexpr const Route* find(std::string_view name) const {
+        std::size_t lo = 0;
+        std::size_t hi = N;
+        while (lo < hi) {
+            const std::size_t mid = lo + (hi - lo) / 2;
+            const int cmp = detail::compare_command_names(_routes[mid].Name, name);
+            if (cmp == 0) {
+                return &_routes[mid];
+            }
+            if (cmp < 0) {
+                lo = mid + 1;
+            } else {
+                hi = mid;
+            }
+        }
+        return nullptr;
+    }
+
+    [[nodiscard]] static constexpr std::size_t size() { return N; }
+
+private:
+    std::array<Route, N> _routes;
+};
+
+/**
+ * Build command table. Table should be a constexpr variable, so that duplicate names fail the build:
+ * @code
+ * inline constexpr auto Commands = tg::make_command_table(
+ *     tg::command<&MyModule::start>("start"),
+ *     tg::command<&MyModule::roll>("roll", "r", "dice"));
+ * @endcode
+ */
+template<typename Class, std::size_t... N>
+constexpr auto make_command_table(const CommandSpec<Class, N>&... specs) {
+    constexpr std::size_t Size = (N + ... + 0);
+    using Table = CommandTable<Class, Size>;
+
+    std::array<typename Table::Route, Size> routes{};
+    std::size_t i = 0;
+    auto append = [&routes, &i](const auto& spec) {
+        for (auto name : spec.Names) {
+            routes[i++] = typename Table::Route{ name, spec.Invoker };
+        }
+    };
+    (append(specs), ...);
+
+    return Table{ routes };
+}
+
+}
@@ -0,0 +1,111 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "tgapi/command/middleware.h"
+#include "tgapi/tgapi.h"
+
+namespace config {
+class Store;
+}
+
+namespace tg {
+
+/**
+ * Token bucket: Burst requests at once, then one request per Interval
+ */
+struct FloodLimit {
+    std::chrono::milliseconds Interval { 1000 };
+    unsigned Burst { 5 };
+};
+
+struct FloodControlConfig {
+    FloodLimit User { std::chrono::milliseconds(1000), 5 };
+    FloodLimit Chat { std::chrono::milliseconds(50), 30 };
+    std::chrono::milliseconds IdleTimeout { 60000 };    // keys idle this long (with full bucket) are evicted
+    std::size_t MaxKeys { 100000 };                     // per limiter
+    bool CommandsOnly { true };                         // plain messages are not limited
+    std::string CooldownNotice { "Too many requests, please slow down" }; // empty to ignore throttled messages silently
+
+    /**
+     * Read <code>Telegram::FloodControl</code> section of the configuration, missing values keep the defaults
+     */
+    static FloodControlConfig from_config(const config::Store& config);
+};
+
+/**
+ * Token bucket rate limiter keyed by user or chat ID.
+ * Keys are spread over shards; known keys are checked under shared lock with a single atomic update,
+ * so only new keys take the shard exclusively. New key also sweeps a few idle keys and, when the shard is full,
+ * evicts a key not used recently in amortized constant time
+ */
+class FloodLimiter final {
+public:
+
+    using Clock = std::chrono::steady_clock;
+
+    enum class Decision {
+        ALLOW,
+        THROTTLE,
+        THROTTLE_FIRST,     // first throttled request since the key was last allowed
+    };
+
+    FloodLimiter(FloodLimit limit, std::chrono::milliseconds idleTimeout, std::size_t maxKeys);
+    FloodLimiter(const FloodLimiter&) = delete;
+    FloodLimiter& operator=(const FloodLimiter&) = delete;
+    ~FloodLimiter();
+
+    /**
+     * Take a token of the key
+     * @param key   User or chat ID
+     * @param now   Current time
+     */
+    Decision acquire(long key, Clock::time_point now = Clock::now());
+
+    /**
+     * Check that the key has a token, without taking it
+     * @param key   User or chat ID
+     * @param now   Current time
+     */
+    [[nodiscard]] bool is_available(long key, Clock::time_point now = Clock::now()) const;
+
+    /**
+     * Get number of tracked keys
+     */
+    [[nodiscard]] std::size_t size() const;
+
+private:
+    struct Impl;
+    UniquePtr<Impl> _impl;
+};
+
+/**
+ * Anti-flood middleware, limits commands per user and per chat.
+ * Throttled user gets a single cooldown notice until they are allowed again:
+ * @code
+ * void post_login(tg::TelegramBot& bot) override {
+ *     set_middleware(tg::make_middleware_chain(tg::FloodControl{ tg::FloodControlConfig::from_config(bot.get_config()) }));
+ * }
+ * @endcode
+ */
+class FloodControl final {
+public:
+
+    explicit FloodControl(FloodControlConfig config = {});
+
+    bool operator()(const MiddlewareContext& context);
+
+    /**
+     * Get number of throttled messages
+     */
+    [[nodiscard]] std::uint64_t get_throttled_count() const;
+
+private:
+    struct State;
+    SharedPtr<State> _state;
+};
+
+}
@@ -1,426 +1,418 @@
 #pragma once
 
-#include <functional>
+#include <cctype>
+#include <charconv>
 #include <cstring>
+#include <chrono>
+#include <functional>
+#include <future>
+#include <memory>
+#include <optional>
 #include <string>
-#include <variant>
-#include <vector>
-#include <cctype>
+#include <string_view>
+#include <tuple>
 #include <type_traits>
-#include <stdexcept>
-#include <cassert>
+#include <utility>
+
+namespace tg {
+class BotInteraction;
+}
 
 namespace tg::function {
 
-enum ArgumentType {
-    Integer,
-    Float,
-    Bool,
-    String,
-};
+/**
+ * Splits command arguments by whitespace.
+ * Argument in double quotes may contain whitespace, quote and backslash inside it are escaped with backslash
+ */
+class ArgumentTokenizer {
+public:
 
-#pragma region Type resolving details
+    struct Token {
+        std::string_view Text;      // without quotes
+        bool Quoted { false };
+        bool Escaped { false };     // contains escape sequences
+    };
 
-namespace detail {
-    template<typename T>
-    constexpr auto ArgumentOf() {
-        using BaseType = std::remove_pointer_t<T>;
-        using DecayType = std::decay_t<BaseType>;
-        if constexpr (std::is_integral_v<DecayType> && !std::is_same_v<bool, DecayType>) {
-            return ArgumentType::Integer;
-        } else if constexpr (std::is_floating_point_v<DecayType>) {
-            return ArgumentType::Float;
-        } else if constexpr (std::is_same_v<DecayType , bool>) {
-            return ArgumentType::Bool;
-        } else if constexpr (std::is_constructible_v<std::string, DecayType>) {
-            return ArgumentType::String;
+    explicit ArgumentTokenizer(std::string_view str)
+        : _str{ str }
+    {}
+
+    /**
+     * Get next token
+     * @return Nothing if there are no tokens left or quoted argument is not closed
+     */
+    std::optional<Token> next() {
+        while (_pos < _str.size() && is_space(_str[_pos])) {
+            ++_pos;
+        }
+        if (_pos == _str.size() || _failed) {
+            return std::nullopt;
         }
-    }
 
-    template<typename T, size_t I>
-    constexpr auto arguments_tuple() {
-        return ArgumentOf< typename std::tuple_element<I, T>::type >();
-    }
+        Token token;
+        if (_str[_pos] == '"') {
+            const std::size_t start = ++_pos;
+            while (_pos < _str.size() && _str[_pos] != '"') {
+                if (_str[_pos] == '\\') {
+                    token.Escaped = true;
+                    ++_pos;
+                }
+                ++_pos;
+            }
+            if (_pos >= _str.size()) {
+                _failed = true;
+                return std::nullopt;
+            }
 
-    template<typename T, size_t... I>
-    constexpr auto arguments_tuple(std::index_sequence<I...>) {
-        return std::make_tuple( arguments_tuple<T, I>()... );
-    }
+            token.Text = _str.substr(start, _pos - start);
+            token.Quoted = true;
+            ++_pos; // closing quote
+            return token;
+        }
 
-    template<typename... Args>
-    constexpr auto arguments_tuple() {
-        return arguments_tuple<std::tuple<Args...>>(std::make_index_sequence<sizeof...(Args)>());
+        const std::size_t start = _pos;
+        while (_pos < _str.size() && !is_space(_str[_pos])) {
+            ++_pos;
+        }
+        token.Text = _str.substr(start, _pos - start);
+        return token;
     }
 
-    template<typename T, typename U, typename = void>
-    struct is_castable : std::false_type {};
-
-    template<typename T, typename U>
-    struct is_castable<T, U, std::void_t<decltype(static_cast<U>(std::declval<T>()))>> : std::true_type {};
-
-    template<typename T, typename U, typename = void>
-    static constexpr bool is_castable_v = is_castable<T, U>::value;
-}
-
-#pragma endregion // Type resolving details
-
-struct ArgumentMapper {
+    /**
+     * Check if quoted argument is not closed
+     */
+    [[nodiscard]] bool failed() const { return _failed; }
 
-    constexpr auto map(bool x) -> bool { return x; }
+private:
+    static bool is_space(char ch) { return std::isspace(static_cast<unsigned char>(ch)) != 0; }
 
-    auto map(const char* x) -> std::string { return std::string{ x }; }
+    std::string_view _str;
+    std::size_t _pos { 0 };
+    bool _failed { false };
+};
 
-    template<typename T, std::enable_if_t<
-            std::is_pointer_v<T>,
-        void**> = nullptr>
-    auto map(T x) {
-        using Base = std::remove_pointer_t<T>;
-        using Mapped = decltype(map(std::declval<Base>()));
-        return (Mapped*)nullptr;
-    }
+/**
+ * Completion of asynchronous handler, which returned a future
+ */
+class PendingResult {
 
-    template<typename T, std::enable_if_t<
-            !std::is_pointer_v<T> &&
-            std::is_same_v<std::string::value_type, typename T::value_type> &&
-            std::is_constructible_v<std::string, T>,
-        void**> = nullptr>
-    auto map(T x) -> std::string { return std::string{ x }; }
+    struct State {
+        virtual ~State() = default;
+        virtual bool is_ready() const = 0;
+        virtual bool is_deferred() const = 0;
+        virtual void get() = 0;
+    };
 
-    template<typename T, std::enable_if_t<std::is_integral_v<T> && !std::is_pointer_v<T>, void**> = nullptr>
-    constexpr auto map(T x) -> long { return static_cast<long>(x); }
+    template<typename T>
+    struct FutureState final : State {
+        explicit FutureState(std::future<T> f) : Future{ std::move(f) } {}
 
-    template<typename T, std::enable_if_t<std::is_floating_point_v<T>, void**> = nullptr>
-    constexpr auto map(T x) -> double { return static_cast<double>(x); }
-};
+        bool is_ready() const override {
+            if (!Future.valid()) {
+                return true;
+            }
+            // deferred future never becomes ready by itself, get() runs it
+            const auto status = Future.wait_for(std::chrono::seconds(0));
+            return status == std::future_status::ready || status == std::future_status::deferred;
+        }
+        bool is_deferred() const override {
+            return Future.valid() && Future.wait_for(std::chrono::seconds(0)) == std::future_status::deferred;
+        }
+        void get() override {
+            if (Future.valid()) {
+                Future.get();
+            }
+        }
 
-class Argument {
+        std::future<T> Future;
+    };
 
 public:
 
-    template<typename U>
-    struct Tag {};
-
-// NOLINTBEGIN
-
-    /**
-     * Construct argument with string value
-     * @param s String value
-     */
-    Argument(std::string s)
-        : _storage{ std::move(s) }
-        , _t{ ArgumentType::String }
+    template<typename T>
+    explicit PendingResult(std::future<T> future)
+        : _state{ std::make_unique<FutureState<T>>(std::move(future)) }
     {}
 
     /**
-     * Construct argument with c-string value
-     * @param s String literal value
+     * Check if handler has completed, never blocks
+     * @throws Exception of the handler once it has completed
      */
-    Argument(const char* s)
-        : _storage{ std::string(s) }
-        , _t { ArgumentType::String }
-    {}
+    bool poll() {
+        if (!_state->is_ready()) {
+            return false;
+        }
+        _state->get();
+        return true;
+    }
 
     /**
-     * Construct argument with boolean value
-     * @param b Boolean value
+     * Check if handler runs only when its result is requested, poll() then runs it on the calling thread
      */
-    Argument(bool b)
-            : _storage{ b }
-            , _t{ ArgumentType::Bool }
-    {}
+    [[nodiscard]] bool is_deferred() const {
+        return _state->is_deferred();
+    }
 
-    /**
-     * Construct argument with long value
-     * @param i Long value
-     */
-    Argument(long i)
-            : _storage{ i }
-            , _t{ ArgumentType::Integer }
-    {}
+private:
+    std::unique_ptr<State> _state;
+};
 
-    /**
-     * Construct argument with double value
-     * @param f Double value
-     */
-    Argument(double f)
-            : _storage{ f }
-            , _t{ ArgumentType::Float }
-    {}
+#pragma region Parsing details
+
+namespace detail {
+
+    using Token = ArgumentTokenizer::Token;
 
     /**
-     * Construct argument with optional value T
-     * @param value Value or nullptr
+     * Storage of std::string_view parameter, escaped argument is unescaped into owned string
      */
-    template<typename T>
-    Argument(Tag<T>, void* value)
-            : _storage{ }
-            , _t { detail::ArgumentOf<T>() }
-    {
-        if (value != nullptr) {
-            _storage = *(T*)value;
-        } else {
-            _null = true;
+    struct TextView {
+        std::string_view View;
+        std::string Owned;
+    };
+
+    inline bool equals_lower(std::string_view s, std::string_view lower) {
+        if (s.size() != lower.size()) {
+            return false;
         }
+        for (std::size_t i = 0; i < s.size(); ++i) {
+            if (std::tolower(static_cast<unsigned char>(s[i])) != lower[i]) {
+                return false;
+            }
+        }
+        return true;
     }
 
-    Argument(const Argument&) = default;
-    Argument(Argument&&) = default;
-
-    constexpr bool is_null() const {
-        return _storage.valueless_by_exception() || _null;
+    inline void unescape(std::string_view s, std::string& out) {
+        out.clear();
+        out.reserve(s.size());
+        for (std::size_t i = 0; i < s.size(); ++i) {
+            if (s[i] == '\\' && i + 1 < s.size()) {
+                ++i;
+            }
+            out.push_back(s[i]);
+        }
     }
 
-    Argument& operator=(const Argument&) = default;
-    Argument& operator=(Argument&&) = default;
+    inline bool parse_value(const Token& token, bool& out) {
+        static constexpr std::string_view trueValues[] = { "y", "1", "yes", "ok", "on", "true" };
+        static constexpr std::string_view falseValues[] = { "n", "0", "no", "off", "false" };
 
-    ~Argument() = default;
+        for (auto value : trueValues) {
+            if (equals_lower(token.Text, value)) {
+                out = true;
+                return true;
+            }
+        }
+        for (auto value : falseValues) {
+            if (equals_lower(token.Text, value)) {
+                out = false;
+                return true;
+            }
+        }
+        return false;
+    }
 
-    template<typename T>
-    auto map() const {
+    template<typename T, std::enable_if_t<std::is_arithmetic_v<T> && !std::is_same_v<T, bool>, void**> = nullptr>
+    bool parse_value(const Token& token, T& out) {
+        std::string_view s = token.Text;
+        if (!s.empty() && s.front() == '+') {
+            s.remove_prefix(1);
+        }
 
-        using MappedType = decltype(ArgumentMapper().map(std::declval<T>()));
-        using BaseType = std::decay_t<std::remove_pointer_t<MappedType>>;
+        const char* end = s.data() + s.size();
+        const auto [ptr, ec] = std::from_chars(s.data(), end, out);
+        return ec == std::errc{} && ptr == end && !s.empty();
+    }
 
-        if (_t != detail::ArgumentOf<BaseType>()) {
-            throw std::bad_cast();
+    inline bool parse_value(const Token& token, std::string& out) {
+        if (token.Escaped) {
+            unescape(token.Text, out);
+        } else {
+            out.assign(token.Text);
         }
+        return true;
+    }
 
-        if constexpr (std::is_pointer_v<T>) {
-            if (is_null()) {
-                return (const BaseType*)nullptr;
-            } else {
-                return &std::get<BaseType>(_storage);
-            }
+    inline bool parse_value(const Token& token, TextView& out) {
+        if (token.Escaped) {
+            unescape(token.Text, out.Owned);
+            out.View = out.Owned;
         } else {
-            const auto& value = std::get<BaseType>(_storage);
-            using RetType = std::conditional_t<detail::is_castable_v<decltype(value), T>, T, decltype(value)>;
-            return static_cast<RetType>(value);
+            out.View = token.Text;
         }
+        return true;
     }
 
-// NOLINTEND
-
-private:
-    // order preserved as in ArgumentType enum
-    std::variant<long, double, bool, std::string> _storage;
-    bool _null { false };
-    ArgumentType _t;
-};
-
-using ArgumentList = std::vector<Argument>;
+    template<typename T> struct ValueStorage { using Type = T; };
+    template<> struct ValueStorage<std::string_view> { using Type = TextView; };
 
-#pragma region Parsing Details
+    template<typename T> T& value_ref(T& value) { return value; }
+    inline std::string_view& value_ref(TextView& value) { return value.View; }
 
-namespace detail {
+    template<typename T>
+    using Bare = std::remove_cv_t<std::remove_reference_t<T>>;
 
     /**
-     * Try parse given string to the corresponding argument type
-     *
-     * @param [in]  arg         Value to parse
-     * @param [in]  type        Type to parse into
-     * @param [out] outArgs     Out container of arguments
-     * @return True if value was parsed and added into the <code>outArgs</code> container
+     * Parsing of a single handler parameter
      */
-    inline bool parse_single_command_argument(
-              std::string& arg
-            , const ArgumentType type
-            , ArgumentList& outArgs
-    )
-    {
-        switch(type) {
-            case Bool:
-            {
-                if (arg == "null") {
-                    outArgs.emplace_back(Argument::Tag<bool>{}, nullptr);
-                    return true;
-                }
+    template<typename P, typename = void>
+    struct Parameter {
+        using Value = Bare<P>;
+        using Storage = typename ValueStorage<Value>::Type;
 
-                if (arg.length() == 1) {
-                    auto ch = arg[0];
-                    if (ch == 'y' || ch =='Y' || ch == '1') {
-                        outArgs.emplace_back(true);
-                    } else if (ch == 'n' || ch == 'N' || ch == '0') {
-                        outArgs.emplace_back(false);
-                    }
-                    return true;
-
-                } else {
-                    static constexpr const char* true_values[] = {
-                            "yes", "ok", "on", "true"
-                    };
-                    static constexpr const char* false_values[] = {
-                            "no", "off", "false"
-                    };
-
-                    for (const auto& true_value : true_values) {
-                        if (arg.length() != std::strlen(true_value)) {
-                            continue;
-                        }
-
-                        bool match = true;
-                        for (std::size_t j = 0; j < arg.length(); ++j) {
-                            if (std::tolower(arg[j]) != true_value[j]) {
-                                match = false;
-                                break;
-                            }
-                        }
-
-                        if (!match) {
-                            continue;
-                        }
-
-                        outArgs.emplace_back(true);
-                        return true;
-                    }
-
-                    for (const auto& false_value : false_values) {
-                        if (arg.length() != std::strlen(false_value)) {
-                            continue;
-                        }
-
-                        bool match = true;
-                        for (std::size_t j = 0; j < arg.length(); ++j) {
-                            if (std::tolower(arg[j] != false_value[j])) {
-                                break;
-                            }
-                        }
-
-                        if (!match) {
-                            continue;
-                        }
-
-                        outArgs.emplace_back(false);
-                        return true;
-                    }
-                }
-            }
-            break;
+        static bool parse(const std::optional<Token>& token, Storage& storage) {
+            return token && parse_value(*token, storage);
+        }
 
-            case String:
-            {
-                if (arg == "null") {
-                    outArgs.emplace_back(Argument::Tag<std::string>{}, nullptr);
-                    return true;
-                }
+        static Value& pass(Storage& storage) { return value_ref(storage); }
+    };
 
-                outArgs.emplace_back(std::move(arg));
+    /**
+     * Pointer parameter is optional, it is null if argument is missing or equals to <code>null</code>
+     */
+    template<typename P>
+    struct Parameter<P, std::enable_if_t<std::is_pointer_v<Bare<P>>>> {
+        using Value = std::remove_cv_t<std::remove_pointer_t<Bare<P>>>;
+        using Storage = std::optional<typename ValueStorage<Value>::Type>;
+
+        static bool parse(const std::optional<Token>& token, Storage& storage) {
+            if (!token || (!token->Quoted && token->Text == "null")) {
                 return true;
             }
-            break;
+            return parse_value(*token, storage.emplace());
+        }
 
-            case Float:
-            {
-                if (arg == "null") {
-                    outArgs.emplace_back(Argument::Tag<float>{}, nullptr);
-                    return true;
-                }
+        static Value* pass(Storage& storage) { return storage ? &value_ref(*storage) : nullptr; }
+    };
 
-                try {
-                    outArgs.emplace_back(std::stod(arg));
-                    return true;
-                } catch (const std::exception& e) {
-                    return false;
-                }
-            }
-            break;
+    template<typename... Params>
+    struct ArgumentParser {
 
-            case Integer:
-            {
-                if (arg == "null") {
-                    outArgs.emplace_back(Argument::Tag<long>{}, nullptr);
-                    return true;
-                }
+        /**
+         * Parse arguments into parameters and pass them to the call
+         * @return False if arguments do not match the parameters
+         */
+        template<typename Call>
+        static bool parse_and_call(std::string_view str, Call&& call) {
+            return parse_and_call(str, std::forward<Call>(call), std::index_sequence_for<Params...>{});
+        }
 
-                try {
-                    outArgs.emplace_back((long)std::stoi(arg));
-                    return true;
-                } catch (const std::exception& e) {
-                    return false;
-                }
+    private:
+        template<typename Call, size_t... I>
+        static bool parse_and_call(std::string_view str, Call&& call, std::index_sequence<I...>) {
+            [[maybe_unused]] std::tuple<typename Parameter<Params>::Storage...> values;
+            [[maybe_unused]] ArgumentTokenizer tokens{ str };
+
+            // fold expression parses arguments left to right and stops at the first mismatch
+            const bool parsed = (Parameter<Params>::parse(tokens.next(), std::get<I>(values)) && ...);
+            if (!parsed || tokens.failed()) {
+                return false;
             }
-            break;
+
+            call(Parameter<Params>::pass(std::get<I>(values))...);
+            return true;
         }
+    };
 
-        return false;
-    }
+    template<typename T>
+    struct is_future : std::false_type {};
 
-    template<template<typename> typename Tuple, typename... Types, std::size_t... I>
-    bool parse_command_arguments_recurse(
-              std::vector<std::string>& args
-            , const Tuple<Types...>& argTypes
-            , ArgumentList& outArgs
-            , std::index_sequence<I...>
-    )
-    {
-        return (parse_single_command_argument(args[I], static_cast<ArgumentType>(std::get<I>(argTypes)), outArgs) && ...);
-    }
+    template<typename T>
+    struct is_future<std::future<T>> : std::true_type {};
 
-    template<template<typename> typename Tuple, typename... Types>
-    bool parse_command_arguments(std::string_view str, const Tuple<Types...>& argTypes, ArgumentList& outArgs) {
-        outArgs.clear();
-
-        std::vector<std::string> split;
-        auto prev = str.begin();
-        auto cur = prev;
-        while (cur <= str.end()) {
-            if (cur == str.end() || std::isspace(*cur)) {
-                size_t start = (prev - str.begin());
-                size_t end   = (cur - str.begin());
-                if (start != end) {
-                    split.emplace_back(str.substr(start, end - start));
-                }
-                ++cur;
-                prev = cur;
-            } else {
-                ++cur;
-            }
+    template<typename ReturnType, typename... Values>
+    void call(std::optional<PendingResult>& pending, Values&&... values) {
+        if constexpr (is_future<ReturnType>::value) {
+            pending.emplace(std::invoke(std::forward<Values>(values)...));
+        } else {
+            std::invoke(std::forward<Values>(values)...);
         }
+    }
 
-        while(split.size() < sizeof...(Types)) {
-            split.emplace_back("null");
-        }
+    template<typename... Args>
+    struct takes_interaction : std::false_type {};
 
-        return parse_command_arguments_recurse(split, argTypes, outArgs, std::make_index_sequence<sizeof...(Types)>());
+    template<typename First, typename... Rest>
+    struct takes_interaction<First, Rest...> : std::is_same<First, const BotInteraction&> {};
+
+    template<typename ReturnType, typename Class, typename... Params>
+    bool invoke(Class& obj, ReturnType (Class::*func)(Params...), const BotInteraction&,
+                std::string_view str, std::optional<PendingResult>& pending, std::false_type) {
+        return ArgumentParser<Params...>::parse_and_call(str, [&](auto&&... values) {
+            call<ReturnType>(pending, func, obj, std::forward<decltype(values)>(values)...);
+        });
     }
+
+    template<typename ReturnType, typename Class, typename... Params>
+    bool invoke(Class& obj, ReturnType (Class::*func)(const BotInteraction&, Params...), const BotInteraction& interaction,
+                std::string_view str, std::optional<PendingResult>& pending, std::true_type) {
+        return ArgumentParser<Params...>::parse_and_call(str, [&](auto&&... values) {
+            call<ReturnType>(pending, func, obj, interaction, std::forward<decltype(values)>(values)...);
+        });
+    }
+
+    template<typename T> struct member_class;
+
+    template<typename ReturnType, typename Class, typename... Args>
+    struct member_class<ReturnType (Class::*)(Args...)> { using type = Class; };
 }
 
 #pragma endregion // Parsing details
 
+/**
+ * Parse arguments straight into a tuple of the handler parameter types and invoke the handler.
+ * Supported parameters are integers and floating point numbers, bool, <code>std::string</code>,
+ * <code>std::string_view</code>, and pointers to them for optional parameters.
+ * Handler may take <code>const BotInteraction&</code> as its first parameter to receive the interaction.
+ * Handler returning <code>std::future</code> is asynchronous, its completion is returned as pending result
+ * @param obj               Handler object
+ * @param func              Handler
+ * @param interaction       Interaction which invoked the command
+ * @param arguments         Argument string
+ * @param [out] pending     Completion of asynchronous handler
+ * @return False if arguments do not match the parameters, handler is not invoked then
+ */
+template<typename ReturnType, typename Class, typename... Args>
+bool invoke(Class& obj, ReturnType (Class::*func)(Args...), const BotInteraction& interaction, std::string_view arguments,
+            std::optional<PendingResult>& pending) {
+    return detail::invoke(obj, func, interaction, arguments, pending, detail::takes_interaction<Args...>{});
+}
+
 class FunctionBase {
 public:
 
     [[nodiscard]] virtual size_t num_parameters() const = 0;
-    [[nodiscard]] virtual bool parse_arguments(std::string_view str, ArgumentList& args) const = 0;
+
+    /**
+     * Parse arguments into handler parameters and invoke the handler
+     * @param interaction   Interaction which invoked the command
+     * @param arguments     Argument string
+     * @param [out] pending Completion of asynchronous handler
+     * @return False if arguments do not match the parameters, handler is not invoked then
+     */
+    virtual bool invoke(const BotInteraction& interaction, std::string_view arguments, std::optional<PendingResult>& pending) = 0;
 
     FunctionBase(const FunctionBase&) = delete;
     FunctionBase& operator=(const FunctionBase&) = delete;
     virtual ~FunctionBase() = default;
 
-    virtual void operator()(const std::vector<Argument>& args) = 0;
-
 protected:
 
     FunctionBase() = default;
 };
 
-
+/**
+ * Command handler bound to its object
+ */
 template<typename ReturnType, typename Class, typename... Args>
 class Function final : public FunctionBase {
 
     using FuncPtr = ReturnType (Class::*)(Args...);
 
-    template<size_t... I>
-    void invoke_helper(const std::vector<Argument>& args, std::index_sequence<I...>) {
-        using Pack = typename std::tuple<Args...>;
-
-        const auto argumentsPack = std::make_tuple( args[I].map<std::tuple_element_t<I, Pack>>()... );
-        std::invoke(_func, _obj, std::get<I>(argumentsPack)...);
-    }
-
 public:
 
-    static constexpr size_t NumArguments = sizeof...(Args);
-    static constexpr auto   ArgumentTypes = detail::arguments_tuple<Args...>();
+    static constexpr size_t NumArguments = sizeof...(Args) - detail::takes_interaction<Args...>::value;
 
     Function(Class* obj, FuncPtr funcPtr)
         : _func{ funcPtr }
@@ -430,16 +422,9 @@ public:
     [[nodiscard]] std::size_t num_parameters() const override {
         return NumArguments;
     }
-    [[nodiscard]] bool parse_arguments(std::string_view str, ArgumentList& args) const override {
-        return detail::parse_command_arguments(str, ArgumentTypes, args);
-    }
 
-    void operator()(const std::vector<Argument>& args) override {
-        if (args.size() >= NumArguments) {
-            invoke_helper(args, std::make_index_sequence<sizeof...(Args)>{});
-        } else {
-            throw std::runtime_error("bad invocation");
-        }
+    bool invoke(const BotInteraction& interaction, std::string_view arguments, std::optional<PendingResult>& pending) override {
+        return function::invoke(*_obj, _func, interaction, arguments, pending);
     }
 
 private:
@@ -449,33 +434,4 @@ private:
 
 };
 
-template<typename ReturnType, typename Class>
-class Function<ReturnType, Class> final : public FunctionBase {
-
-    using FuncPtr = ReturnType (Class::*)();
-
-    void invoke_helper() {
-        std::invoke(_func, _obj);
-    }
-public:
-
-    Function(Class* obj, FuncPtr funcPtr)
-        : _func{ funcPtr }
-        , _obj{ obj }
-    {}
-
-    [[nodiscard]] std::size_t num_parameters() const override { return 0; }
-    [[nodiscard]] bool parse_arguments(std::string_view str, tg::function::ArgumentList &args) const override { return true; }
-
-    void operator()(const std::vector<Argument>& args) override {
-        invoke_helper();
-    }
-
-private:
-    FuncPtr _func;
-    Class* _obj;
-};
-
-
-
-};
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <list>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "tgapi/types/api_types.h"
+
+namespace tg {
+
+struct InlineQueryOptions {
+    std::size_t PageSize { 20 };                // results per answer, Telegram accepts up to 50
+    std::size_t CacheCapacity { 1024 };         // distinct queries
+    std::chrono::milliseconds CacheTtl { 300000 };
+    int ClientCacheTime { 300 };                // seconds Telegram may cache the answer
+};
+
+/**
+ * Normalize inline query text: trim, collapse whitespace and lower case ASCII letters
+ */
+std::string normalize_inline_query(std::string_view query);
+
+/**
+ * LRU cache of inline query results keyed by normalized query text
+ */
+class InlineResultCache final {
+public:
+
+    using Clock = std::chrono::steady_clock;
+    using Results = SharedPtr<const std::vector<InlineQueryResult>>;
+
+    InlineResultCache(std::size_t capacity, std::chrono::milliseconds ttl);
+
+    /**
+     * @return Null if query is not cached or its results have expired
+     */
+    Results find(std::string_view key, Clock::time_point now = Clock::now());
+
+    void insert(std::string_view key, Results results, Clock::time_point now = Clock::now());
+
+    [[nodiscard]] std::size_t size() const;
+
+private:
+
+    struct Entry {
+        std::string Key;
+        Results Value;
+        Clock::time_point Expires;
+    };
+
+    mutable std::mutex _mutex;
+    std::list<Entry> _entries;  // most recently used first
+    std::unordered_map<std::string_view, std::list<Entry>::iterator> _index;    // keys view into entries
+    std::size_t _capacity;
+    std::chrono::milliseconds _ttl;
+};
+
+}
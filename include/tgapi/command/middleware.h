@@ -0,0 +1,101 @@
+#pragma once
+
+#include <cstddef>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+namespace tg {
+
+class BotInteraction;
+struct CommandView;
+
+/**
+ * Message passed through middleware
+ */
+struct MiddlewareContext {
+    const BotInteraction& Interaction;
+    const CommandView* Command;     // null for plain message
+};
+
+/**
+ * Middleware composed at compile time, see tg::make_middleware_chain().
+ * Middleware is a callable of one of two forms:
+ *
+ *  - filter <code>bool (const MiddlewareContext&)</code>, returns false to reject the message;
+ *  - wrapper <code>void (const MiddlewareContext&, Next& next)</code>, calls <code>next()</code> to run the rest of
+ *    the chain and the handler, or does not call it to reject the message.
+ *
+ * Calls are resolved statically, so a chain of filters costs as much as the filters themselves
+ */
+template<typename... Middleware>
+class MiddlewareChain final {
+public:
+
+    explicit MiddlewareChain(Middleware... middleware)
+        : _middleware{ std::move(middleware)... }
+    {}
+
+    /**
+     * Pass message through the chain
+     * @param context   Message
+     * @param handler   Called if no middleware rejects the message
+     * @return False if message is rejected
+     */
+    template<typename Handler>
+    bool run(const MiddlewareContext& context, Handler&& handler) {
+        return run_from<0>(context, handler);
+    }
+
+    /**
+     * Append middleware to the end of the chain
+     */
+    template<typename Next>
+    MiddlewareChain<Middleware..., Next> then(Next next) && {
+        return std::apply([&next](auto&... middleware) {
+            return MiddlewareChain<Middleware..., Next>{ std::move(middleware)..., std::move(next) };
+        }, _middleware);
+    }
+
+    [[nodiscard]] static constexpr std::size_t size() { return sizeof...(Middleware); }
+
+private:
+
+    template<std::size_t I, typename Handler>
+    bool run_from(const MiddlewareContext& context, Handler& handler) {
+        if constexpr (I == sizeof...(Middleware)) {
+            handler();
+            return true;
+        } else {
+            auto& middleware = std::get<I>(_middleware);
+
+            if constexpr (std::is_invocable_r_v<bool, decltype(middleware), const MiddlewareContext&>) {
+                return middleware(context) && run_from<I + 1>(context, handler);
+            } else {
+                bool passed = false;
+                auto next = [this, &context, &handler, &passed] {
+                    passed = run_from<I + 1>(context, handler);
+                };
+                middleware(context, next);
+                return passed;
+            }
+        }
+    }
+
+    std::tuple<Middleware...> _middleware;
+};
+
+/**
+ * Build middleware chain, middleware runs in order of arguments:
+ * @code
+ * set_middleware(tg::make_middleware_chain(
+ *     [](const tg::MiddlewareContext& c) { return !is_banned(c.Interaction.get_message().From.Id); },
+ *     [](const tg::MiddlewareContext& c, auto& next) { Stopwatch sw; next(); report(sw); }));
+ * @endcode
+ */
+template<typename... Middleware>
+MiddlewareChain<Middleware...> make_middleware_chain(Middleware... middleware) {
+    return MiddlewareChain<Middleware...>{ std::move(middleware)... };
+}
+
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace tg {
+
+/**
+ * Finds many phrases in a text in a single pass (Aho-Corasick automaton).
+ * Matching is case insensitive for ASCII letters. Bytes which do not occur in any phrase share one input class,
+ * so transition table has a row of only a few columns per state
+ */
+class TriggerMatcher final {
+public:
+
+    struct Match {
+        std::size_t Id;             // id the phrase was added with
+        std::size_t Position;       // in bytes
+        std::size_t Length;
+    };
+
+    /**
+     * Add phrase, matcher must be compiled again
+     * @param phrase        Phrase, not empty
+     * @param id            Returned with matches of the phrase
+     * @param wholeWord     Match only if phrase is not a part of a longer word
+     */
+    void add(std::string_view phrase, std::size_t id, bool wholeWord = false);
+
+    /**
+     * Build automaton of the added phrases
+     */
+    void compile();
+
+    [[nodiscard]] bool is_compiled() const { return _compiled; }
+    [[nodiscard]] std::size_t size() const { return _phrases.size(); }
+
+    /**
+     * Find all occurrences of the phrases, in order of their end
+     * @param text          Text
+     * @param [out] matches Matches are appended
+     */
+    void find_all(std::string_view text, std::vector<Match>& matches) const;
+
+private:
+
+    struct Phrase {
+        std::string Text;   // lower case
+        std::size_t Id;
+        bool WholeWord;
+    };
+
+    [[nodiscard]] bool is_whole_word(std::string_view text, std::size_t position, std::size_t length) const;
+
+    std::vector<Phrase> _phrases;
+    bool _compiled { false };
+
+    std::array<std::uint16_t, 256> _byteClass {};   // 0 is the class of bytes which are not in any phrase
+    std::array<bool, 256> _firstByte {};            // bytes which start a phrase, text is skipped to them from root
+    std::size_t _numClasses { 1 };
+    std::vector<std::uint32_t> _transitions;        // state * _numClasses + class
+    std::vector<std::uint32_t> _outputStart;        // phrases ending in state s are _outputs[_outputStart[s].._outputStart[s + 1]]
+    std::vector<std::uint32_t> _outputs;            // phrase indices
+};
+
+}
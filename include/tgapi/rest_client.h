@@ -71,7 +71,7 @@ private:
 class Response final {
 public:
 
-    explicit Response(std::string_view content);
+    explicit Response(std::string content);
 
     Response(const Response&) = default;
     Response(Response&&) = default;
@@ -80,8 +80,10 @@ public:
     ~Response() = default;
 
     [[nodiscard]] const JDoc* get_json() const;
+    [[nodiscard]] std::string_view get_content() const;
 
 private:
+    std::shared_ptr<const std::string> _content;
     std::shared_ptr<JDoc> _doc;
 };
 
@@ -96,7 +98,7 @@ public:
 
     using Callback = std::function<void(const Response&)>;
 
-    Client();
+    explicit Client(std::size_t numThreads = 4);
     Client(const Client&) = delete;
     Client& operator=(const Client&) = delete;
     ~Client();
@@ -107,6 +109,11 @@ public:
     Response get(const Request& request);
     Response post(const Request& request);
 
+    /**
+     * Stop the client thread pool and join its threads. Requests in flight are abandoned
+     */
+    void shutdown();
+
 private:
     UniquePtr<Impl> _impl;
 };
@@ -6,6 +6,7 @@
 #include <vector>
 #include <optional>
 #include <variant>
+#include <string_view>
 
 #include "tgapi/tgapi.h"
 
@@ -131,6 +132,72 @@ struct Message {
     std::vector<MessageEntity> Entites;
 };
 
+struct CallbackQuery {
+    std::string Id;
+    User From;
+    std::optional<tg::Message> Message;
+    std::string InlineMessageId;
+    std::string ChatInstance;
+    std::string Data;
+};
+
+struct InlineKeyboardButton {
+    std::string Text;
+    std::string CallbackData;   // up to 64 bytes, see tg::CallbackRoute
+    std::string Url;            // either url or callback data is set
+};
+
+struct InlineKeyboardMarkup {
+    std::vector<std::vector<InlineKeyboardButton>> InlineKeyboard;
+};
+
+struct AnswerCallbackQueryParams {
+    std::string CallbackQueryId;
+    std::string Text;
+    bool ShowAlert { false };
+};
+
+struct InlineQuery {
+    std::string Id;
+    User From;
+    std::string Query;
+    std::string Offset;
+    std::string ChatType;
+};
+
+/**
+ * Article result of inline query, sends the message text when chosen
+ */
+struct InlineQueryResult {
+    std::string Id;
+    std::string Title;
+    std::string Description;
+    std::string MessageText;
+};
+
+struct AnswerInlineQueryParams {
+    std::string InlineQueryId;
+    std::vector<InlineQueryResult> Results;
+    std::optional<int> CacheTime;   // seconds the client may cache the answer
+    bool IsPersonal { false };
+    std::string NextOffset;         // empty if there are no more results
+};
+
+struct PreCheckoutQuery {
+    std::string Id;
+    User From;
+    std::string Currency;
+    long TotalAmount { 0 };
+    std::string InvoicePayload;
+    std::string ShippingOptionId;
+};
+
+struct AnswerPreCheckoutQueryParams {
+    std::string PreCheckoutQueryId;
+    bool Ok { false };
+    std::string ErrorMessage;
+};
+
 struct BotLogin {
     bool OK{false};
     User Profile;
@@ -146,6 +213,18 @@ private:
                 new (&UpdateData.Message) tg::Message{u.UpdateData.Message};
                 break;
 
+            case INLINE_QUERY:
+                new (&UpdateData.InlineQuery) tg::InlineQuery{u.UpdateData.InlineQuery};
+                break;
+
+            case CALLBACK_QUERY:
+                new (&UpdateData.CallbackQuery) tg::CallbackQuery{u.UpdateData.CallbackQuery};
+                break;
+
+            case PRE_CHECKOUT_QUERY:
+                new (&UpdateData.PreCheckoutQuery) tg::PreCheckoutQuery{u.UpdateData.PreCheckoutQuery};
+                break;
+
             default:
                 break;
         }
@@ -158,6 +237,18 @@ private:
                 new (&UpdateData.Message) tg::Message{std::move(u.UpdateData.Message)};
                 break;
 
+            case INLINE_QUERY:
+                new (&UpdateData.InlineQuery) tg::InlineQuery{std::move(u.UpdateData.InlineQuery)};
+                break;
+
+            case CALLBACK_QUERY:
+                new (&UpdateData.CallbackQuery) tg::CallbackQuery{std::move(u.UpdateData.CallbackQuery)};
+                break;
+
+            case PRE_CHECKOUT_QUERY:
+                new (&UpdateData.PreCheckoutQuery) tg::PreCheckoutQuery{std::move(u.UpdateData.PreCheckoutQuery)};
+                break;
+
             default:
                 break;
         }
@@ -188,6 +279,9 @@ public:
     union Update {
         bool _dummy;
         tg::Message Message;
+        tg::InlineQuery InlineQuery;
+        tg::CallbackQuery CallbackQuery;
+        tg::PreCheckoutQuery PreCheckoutQuery;
 
         Update() : _dummy{false} {}
         ~Update() { }
@@ -203,6 +297,24 @@ public:
         new (&UpdateData.Message) tg::Message{ std::move(m) };
     }
 
+    void set_update(tg::InlineQuery&& q) {
+        assert(UpdateType == 0);
+        UpdateType = INLINE_QUERY;
+        new (&UpdateData.InlineQuery) tg::InlineQuery{ std::move(q) };
+    }
+
+    void set_update(tg::CallbackQuery&& q) {
+        assert(UpdateType == 0);
+        UpdateType = CALLBACK_QUERY;
+        new (&UpdateData.CallbackQuery) tg::CallbackQuery{ std::move(q) };
+    }
+
+    void set_update(tg::PreCheckoutQuery&& q) {
+        assert(UpdateType == 0);
+        UpdateType = PRE_CHECKOUT_QUERY;
+        new (&UpdateData.PreCheckoutQuery) tg::PreCheckoutQuery{ std::move(q) };
+    }
+
     BotUpdate()
         : Id { 0 }
         , UpdateType { 0 }
@@ -236,12 +348,71 @@ public:
                 UpdateData.Message.~Message();
                 break;
 
+            case INLINE_QUERY:
+                UpdateData.InlineQuery.~InlineQuery();
+                break;
+
+            case CALLBACK_QUERY:
+                UpdateData.CallbackQuery.~CallbackQuery();
+                break;
+
+            case PRE_CHECKOUT_QUERY:
+                UpdateData.PreCheckoutQuery.~PreCheckoutQuery();
+                break;
+
             default:
                 break;
         }
     }
 };
 
+using UpdateTypeMask = std::uint32_t;
+
+/**
+ * Get the bit of the update type in the update type mask
+ * @param type  Update type (see <code>BotUpdate::Type</code>)
+ * @return Mask bit
+ */
+constexpr UpdateTypeMask update_type_bit(int type) {
+    return UpdateTypeMask{ 1 } << type;
+}
+
+/**
+ * Get the Bot API name of the update type (as used in <code>allowed_updates</code>)
+ * @param type  Update type (see <code>BotUpdate::Type</code>)
+ * @return Update type name or empty string if type is unknown
+ */
+constexpr std::string_view update_type_name(int type) {
+    switch(type) {
+        case BotUpdate::MESSAGE:                return "message";
+        case BotUpdate::EDITED_MESSAGE:         return "edited_message";
+        case BotUpdate::CHANNEL_POST:           return "channel_post";
+        case BotUpdate::EDITED_CHANNEL_POST:    return "edited_channel_post";
+        case BotUpdate::MESSAGE_REACTION:       return "message_reaction";
+        case BotUpdate::MESSAGE_REACTION_COUNT: return "message_reaction_count";
+        case BotUpdate::INLINE_QUERY:           return "inline_query";
+        case BotUpdate::CHOSEN_INLINE_RESULT:   return "chosen_inline_result";
+        case BotUpdate::CALLBACK_QUERY:         return "callback_query";
+        case BotUpdate::SHOPPING_QUERY:         return "shipping_query";
+        case BotUpdate::PRE_CHECKOUT_QUERY:     return "pre_checkout_query";
+        case BotUpdate::POLL:                   return "poll";
+        case BotUpdate::POLL_ANSWER:            return "poll_answer";
+        case BotUpdate::MY_CHAT_NUMBER:         return "my_chat_member";
+        case BotUpdate::CHAT_MEMBER:            return "chat_member";
+        case BotUpdate::CHAT_JOIN_REQUEST:      return "chat_join_request";
+        case BotUpdate::CHAT_BOOST:             return "chat_boost";
+        case BotUpdate::REMOVED_CHAT_BOOST:     return "removed_chat_boost";
+        default:                                return "";
+    }
+}
+
+/**
+ * Set of update types the bot wants to receive
+ */
+struct AllowedUpdates {
+    UpdateTypeMask Mask { 0 };
+};
+
 struct BotGetUpdates {
     bool OK { false };
     std::vector<BotUpdate> Updates;
@@ -66,7 +66,9 @@ auto do_parse(const std::vector<To>& arr, ParseTag<JValue>, JAlloc& a) -> JValue
 template<typename To>
 auto do_parse(const JConstObj& d, ParseTag<Result<To>>) {
     if (d["ok"].GetBool()) {
-        if constexpr (detail::IsIndexedAccess<To>::value) {
+        if constexpr (std::is_arithmetic_v<To>) {
+            return Result<To>::from_content( d["result"].Get<To>() );
+        } else if constexpr (detail::IsIndexedAccess<To>::value) {
             return Result<To>::from_content( do_parse<To>(d["result"].GetArray()) );
         } else {
             return Result<To>::from_content( do_parse<To>(d["result"].GetObj()) );
@@ -89,6 +91,18 @@ inline auto do_parse(const ChatId& id, ParseTag<JValue>, JAlloc& a) {
 }
 
 
+inline auto do_parse(const AllowedUpdates& u, ParseTag<JValue>, JAlloc& a) {
+    JValue value { rapidjson::kArrayType };
+    for (int type = BotUpdate::MESSAGE; type <= BotUpdate::REMOVED_CHAT_BOOST; ++type) {
+        if (u.Mask & update_type_bit(type)) {
+            const std::string_view name = update_type_name(type);
+            value.PushBack( JValue{ name.data(), static_cast<rapidjson::SizeType>(name.size()) }, a );
+        }
+    }
+    return value;
+}
+
+
 inline auto do_parse(const JConstObj& d, ParseTag<ReplyParameters>) {
     tg::ReplyParameters p;
 
@@ -243,6 +257,122 @@ inline auto do_parse(const JConstObj& d, ParseTag<tg::Message>) {
 }
 
 
+inline auto do_parse(const JConstObj& d, ParseTag<tg::CallbackQuery>) {
+    tg::CallbackQuery q;
+
+    detail::map_json_value(d, "id", [&q](const JValue& v) { q.Id = v.GetString(); });
+    detail::map_json_value(d, "from", [&q](const JValue& v) { q.From = parse::do_parse<tg::User>(v.GetObj()); });
+    detail::map_json_value(d, "message", [&q](const JValue& v) { q.Message = parse::do_parse<tg::Message>(v.GetObj()); });
+    detail::map_json_value(d, "inline_message_id", [&q](const JValue& v) { q.InlineMessageId = v.GetString(); });
+    detail::map_json_value(d, "chat_instance", [&q](const JValue& v) { q.ChatInstance = v.GetString(); });
+    detail::map_json_value(d, "data", [&q](const JValue& v) { q.Data = v.GetString(); });
+
+    return q;
+}
+
+inline auto do_parse(const InlineKeyboardButton& b, ParseTag<JValue>, JAlloc& a) {
+    JValue o { rapidjson::kObjectType };
+    {
+        o.AddMember("text", JValue{ b.Text.c_str(), a }, a);
+        if (!b.Url.empty()) {
+            o.AddMember("url", JValue{ b.Url.c_str(), a }, a);
+        } else {
+            o.AddMember("callback_data", JValue{ b.CallbackData.data(), static_cast<rapidjson::SizeType>(b.CallbackData.size()), a }, a);
+        }
+    }
+    return o;
+}
+
+inline auto do_parse(const InlineKeyboardMarkup& m, ParseTag<JValue>, JAlloc& a) {
+    JValue o { rapidjson::kObjectType };
+    {
+        o.AddMember("inline_keyboard", do_parse<JValue>(m.InlineKeyboard, a), a);
+    }
+    return o;
+}
+
+inline auto do_parse(const AnswerCallbackQueryParams& p, ParseTag<JValue>, JAlloc& a) {
+    JValue o { rapidjson::kObjectType };
+    {
+        o.AddMember("callback_query_id", JValue{ p.CallbackQueryId.c_str(), a }, a);
+        if (!p.Text.empty()) {
+            o.AddMember("text", JValue{ p.Text.c_str(), a }, a);
+        }
+        o.AddMember("show_alert", p.ShowAlert, a);
+    }
+    return o;
+}
+
+
+inline auto do_parse(const JConstObj& d, ParseTag<tg::InlineQuery>) {
+    tg::InlineQuery q;
+
+    detail::map_json_value(d, "id", [&q](const JValue& v) { q.Id = v.GetString(); });
+    detail::map_json_value(d, "from", [&q](const JValue& v) { q.From = parse::do_parse<tg::User>(v.GetObj()); });
+    detail::map_json_value(d, "query", [&q](const JValue& v) { q.Query = v.GetString(); });
+    detail::map_json_value(d, "offset", [&q](const JValue& v) { q.Offset = v.GetString(); });
+    detail::map_json_value(d, "chat_type", [&q](const JValue& v) { q.ChatType = v.GetString(); });
+
+    return q;
+}
+
+inline auto do_parse(const InlineQueryResult& r, ParseTag<JValue>, JAlloc& a) {
+    JValue o { rapidjson::kObjectType };
+    {
+        o.AddMember("type", "article", a);
+        o.AddMember("id", JValue{ r.Id.c_str(), a }, a);
+        o.AddMember("title", JValue{ r.Title.c_str(), a }, a);
+        if (!r.Description.empty()) {
+            o.AddMember("description", JValue{ r.Description.c_str(), a }, a);
+        }
+
+        JValue content { rapidjson::kObjectType };
+        content.AddMember("message_text", JValue{ r.MessageText.c_str(), a }, a);
+        o.AddMember("input_message_content", content, a);
+    }
+    return o;
+}
+
+inline auto do_parse(const AnswerInlineQueryParams& p, ParseTag<JValue>, JAlloc& a) {
+    JValue o { rapidjson::kObjectType };
+    {
+        o.AddMember("inline_query_id", JValue{ p.InlineQueryId.c_str(), a }, a);
+        o.AddMember("results", do_parse<JValue>(p.Results, a), a);
+        if (p.CacheTime) {
+            o.AddMember("cache_time", *p.CacheTime, a);
+        }
+        o.AddMember("is_personal", p.IsPersonal, a);
+        o.AddMember("next_offset", JValue{ p.NextOffset.c_str(), a }, a);
+    }
+    return o;
+}
+
+inline auto do_parse(const JConstObj& d, ParseTag<tg::PreCheckoutQuery>) {
+    tg::PreCheckoutQuery q;
+
+    detail::map_json_value(d, "id", [&q](const JValue& v) { q.Id = v.GetString(); });
+    detail::map_json_value(d, "from", [&q](const JValue& v) { q.From = parse::do_parse<tg::User>(v.GetObj()); });
+    detail::map_json_value(d, "currency", [&q](const JValue& v) { q.Currency = v.GetString(); });
+    detail::map_json_value(d, "total_amount", [&q](const JValue& v) { q.TotalAmount = v.GetInt64(); });
+    detail::map_json_value(d, "invoice_payload", [&q](const JValue& v) { q.InvoicePayload = v.GetString(); });
+    detail::map_json_value(d, "shipping_option_id", [&q](const JValue& v) { q.ShippingOptionId = v.GetString(); });
+
+    return q;
+}
+
+inline auto do_parse(const AnswerPreCheckoutQueryParams& p, ParseTag<JValue>, JAlloc& a) {
+    JValue o { rapidjson::kObjectType };
+    {
+        o.AddMember("pre_checkout_query_id", JValue{ p.PreCheckoutQueryId.c_str(), a }, a);
+        o.AddMember("ok", p.Ok, a);
+        if (!p.Ok) {
+            o.AddMember("error_message", JValue{ p.ErrorMessage.c_str(), a }, a);
+        }
+    }
+    return o;
+}
+
+
 inline auto do_parse(const JConstObj& d, ParseTag<tg::BotUpdate>) {
     BotUpdate u;
 
@@ -251,6 +381,15 @@ inline auto do_parse(const JConstObj& d, ParseTag<tg::BotUpdate>) {
     if (d.HasMember("message")) {
         auto m = parse::do_parse<tg::Message>(d["message"].GetObj());
         u.set_update(std::move(m));
+    } else if (d.HasMember("inline_query")) {
+        auto q = parse::do_parse<tg::InlineQuery>(d["inline_query"].GetObj());
+        u.set_update(std::move(q));
+    } else if (d.HasMember("callback_query")) {
+        auto q = parse::do_parse<tg::CallbackQuery>(d["callback_query"].GetObj());
+        u.set_update(std::move(q));
+    } else if (d.HasMember("pre_checkout_query")) {
+        auto q = parse::do_parse<tg::PreCheckoutQuery>(d["pre_checkout_query"].GetObj());
+        u.set_update(std::move(q));
     }
 
     return u;
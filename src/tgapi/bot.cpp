@@ -1,4 +1,7 @@
 #include "tgapi/bot/bot.h"
+#include "tgapi/bot/bot_host.h"
+#include "tgapi/bot/update_dispatcher.h"
+#include "tgapi/bot/update_recorder.h"
 #include "tgapi/rest_client.h"
 #include "tgapi/fmt/tgbot_fmt.h"
 #include "tgapi/types/api_types_parse.h"
@@ -7,8 +10,11 @@
 #include "util.h"
 #include "sqlite/sqlite.h"
 
-#include <list>
+#include <algorithm>
+#include <atomic>
 #include <thread>
+#include <unordered_map>
+#include <boost/asio/post.hpp>
 #include <boost/asio/thread_pool.hpp>
 #include <filesystem>
 #include <utility>
@@ -32,319 +38,125 @@ auto do_parse(const SendMessageParams& p, ParseTag<JValue>, JAlloc& a) {
         if (p.Reply) {
             o.AddMember("reply_parameters", do_parse<JValue>(*p.Reply, a), a);
         }
+        if (p.ReplyMarkup) {
+            o.AddMember("reply_markup", do_parse<JValue>(*p.ReplyMarkup, a), a);
+        }
     }
     return o;
 }
 
-}
-
-#pragma endregion // Parse
-
-
-#pragma region Timer service
-
-namespace detail {
-
-class TimerData {
-public:
-
-    using HandleType    = long;
-    using ClockType     = typename boost::posix_time::microsec_clock;
-    using TimePointType = typename boost::posix_time::ptime;
-    using IntervalType  = typename boost::posix_time::time_duration;
-    using CallbackType  = typename std::function<void(TimerReply&)>;
-
-    TimerData(HandleType handle, CallbackType cb, IntervalType interval, const TimePointType& tp, bool looping)
-        : _expiresAt{ tp }
-        , _cb { std::move(cb) }
-        , _interval{ interval }
-        , _handle { handle }
-        , _loop{ looping }
-    {}
-    TimerData(HandleType handle, CallbackType cb, IntervalType interval, bool looping)
-        : _expiresAt{ ClockType::universal_time() + interval }
-        , _cb { std::move(cb) }
-        , _interval{ interval }
-        , _handle { handle }
-        , _loop{ looping }
-    {}
-    TimerData(HandleType handle, CallbackType cb, long intervalSeconds, bool looping)
-        : TimerData(handle, std::move(cb), boost::posix_time::seconds(intervalSeconds), looping)
-    {}
-
-    TimerData(const TimerData&) = default;
-    TimerData(TimerData&&) = default;
-    TimerData& operator=(const TimerData&) = default;
-    TimerData& operator=(TimerData&&) = default;
-
-    [[nodiscard]] TimePointType expires_at() const { return _expiresAt; }
-
-    void refresh() {
-        _expiresAt = ClockType::universal_time() + _interval;
-    }
-
-    void refresh(IntervalType time) {
-        _interval = time;
-        refresh();
-    }
-
-    void refresh(long seconds) {
-        _interval = boost::posix_time::seconds(seconds);
-        refresh();
-    }
-
-    [[nodiscard]] bool looping() const { return _loop; }
-    [[nodiscard]] long handle() const { return _handle; }
-
-    void operator()(TimerReply& r) {
-        _cb(r);
-    }
-
-    [[nodiscard]] auto time_remaining() const {
-        return expires_at() - ClockType::universal_time();
-    }
-
-    [[nodiscard]] IntervalType interval() const {
-        return _interval;
-    }
-
-private:
-    TimePointType _expiresAt;
-    HandleType _handle;
-    boost::posix_time::time_duration _interval;
-    CallbackType _cb;
-    bool _loop;
-};
-
-bool operator> (const TimerData& a, const TimerData& b) {
-    return a.expires_at() > b.expires_at();
-}
-
-bool operator< (const TimerData& a, const TimerData& b) {
-    return a.expires_at() < b.expires_at();
-}
-
-bool operator==(const TimerData& a, const long h) {
-    return a.handle() == h;
-}
-
-}
-
-class TimerService::Impl {
-
-    void worker_thread() {
-        while(true) {
-
-            {
-                std::unique_lock<std::recursive_mutex> lock { _mutex };
-                if (_timers.empty()) {
-                    // sleep
-                    lock.unlock();
-
-                    std::unique_lock<std::mutex> workerLock { _workerMutex };
-                    _logger->info("Waiting for timers");
-                    _cv.wait(workerLock);
-
-                    _logger->info("Signal process timers");
-                    continue;
-                }
-            }
-
-            {
-                bool needSort = false;
-
-                const auto now = detail::TimerData::ClockType::universal_time();
-
-                std::unique_lock<std::recursive_mutex> lock { _mutex };
-                for (auto it = _timers.begin(); it != _timers.cend();) {
-                    auto& data = *it;
-                    auto handle = data.handle();
-                    const auto diff = (data.expires_at() - now).total_milliseconds();
-                    if (diff < 0) {
-
-                        TimerReply r{ handle };
-                        // @todo Post on thread pool?
-                        data(r);
-
-                        if (r.is_delete()) {
-                            _logger->info("Deleted timer h = {}", data.handle());
-                            it = _timers.erase(it);
-                            continue;
-                        }
-                        else if (r.is_interval()) {
-                            const auto newInterval = boost::posix_time::milliseconds(r.interval());
-                            data.refresh(newInterval);
-
-                            _logger->info("Updated timer h = {} new = {}s", data.handle(), newInterval.total_seconds());
-                        }
-
-                        if (data.looping()) {
-                            data.refresh();
-                            needSort = true;
-                            _logger->info("Refresh timer h = {}", data.handle());
-                        }
-                        else {
-                            // timer has expired
-                            _logger->info("Erased timer h = {}", data.handle());
-                            it = _timers.erase(it);
-                        }
-
-                    } else {
-                        lock.unlock();
-
-                        const long sleepTime = std::max<long>(data.time_remaining().total_seconds(), 0l);
-
-                        if (sleepTime > 0) {
-                            _logger->info("All timers are in process. Went sleeping for {}s", sleepTime);
-
-                            std::unique_lock<std::mutex> workerLock{_workerMutex};
-                            _waiting = true;
-                            _cv.wait_for(workerLock, std::chrono::seconds(sleepTime), [this] {
-                                return !_waiting;
-                            });
-                        }
-
-                        break;
-                    }
-                }
-
-                if (needSort) {
-                    _timers.sort();
-                }
-            }
-        }
-    }
-
-public:
-
-    Impl() {
-        _logger = mylog::LogManager::get().create_logger("Timers");
-        _thread = std::thread{ &Impl::worker_thread, this };
-        _thread.detach();
-    }
-
-    Impl(const Impl&) = delete;
-    Impl(Impl&&) = delete;
-    const Impl& operator=(const Impl&) = delete;
-    const Impl& operator=(Impl&&) = delete;
-
-    void add_timer(const std::function<void(TimerReply&)>& callback, long handle, long interval, bool looping) {
-        std::unique_lock<std::recursive_mutex> lock{ _mutex };
-
-        _timers.emplace_back(handle, callback, interval, looping);
-        _timers.sort();
-
-        _logger->info("Added timer h = {} interval = {}s", handle, interval);
-
-        {
-            std::unique_lock<std::mutex> workerLock { _workerMutex };
-            _waiting = false;
-            _cv.notify_one();
-        }
-    }
-
-    void update_timer(long handle, long interval) {
-        std::unique_lock<std::recursive_mutex> lock{ _mutex };
-        auto it = std::find(_timers.begin(), _timers.end(), handle);
-        if (it != _timers.end()) {
-            auto& data = *it;
-            data.refresh(interval);
-
-            _logger->info("Updated timer h = {} new = {}s", handle, interval);
-
-            {
-                std::unique_lock<std::mutex> workerLock { _workerMutex };
-                _waiting = false;
-                _cv.notify_one();
-            }
+auto do_parse(const SetWebhookParams& p, const AllowedUpdates& allowed, ParseTag<JValue>, JAlloc& a) {
+    JValue o{ rapidjson::kObjectType };
+    {
+        o.AddMember("url", JValue{ p.Url.c_str(), a }, a);
+        o.AddMember("allowed_updates", do_parse<JValue>(allowed, a), a);
+        o.AddMember("drop_pending_updates", p.DropPendingUpdates, a);
+        if (p.MaxConnections) {
+            o.AddMember("max_connections", *p.MaxConnections, a);
         }
     }
+    return o;
+}
 
-    bool delete_timer(long handle) {
-        std::unique_lock<std::recursive_mutex> lock{ _mutex };
-
-        auto it = std::find(_timers.cbegin(), _timers.cend(), handle);
-        if (it != _timers.cend()) {
-            _timers.erase(it);
-            _timers.sort();
-
-            {
-                std::unique_lock<std::mutex> workerLock { _workerMutex };
-                _waiting = false;
-                _cv.notify_one();
+/**
+ * Serialize allowed update types as query parameter value (json array of type names)
+ * @param u Allowed updates
+ * @return Json array string
+ */
+std::string to_query_value(const AllowedUpdates& u) {
+    std::string result = "[";
+    for (int type = BotUpdate::MESSAGE; type <= BotUpdate::REMOVED_CHAT_BOOST; ++type) {
+        if (u.Mask & update_type_bit(type)) {
+            if (result.length() > 1) {
+                result += ',';
             }
-
-            return true;
+            result += '"';
+            result += update_type_name(type);
+            result += '"';
         }
-
-        return false;
     }
-
-    ~Impl() = default;
-
-private:
-    std::thread _thread;
-    std::recursive_mutex _mutex;
-
-    std::mutex _workerMutex;
-    bool _waiting { false };
-    std::condition_variable _cv;
-
-    mylog::LoggerPtr _logger;
-
-    std::list<detail::TimerData> _timers; // we could use priority_queue, but we need iterators
-};
-
-void TimerService::add_timer(const std::function<void(TimerReply&)>& callback, long handle, long interval, bool looping) {
-    _impl->add_timer(callback, handle, interval, looping);
+    result += ']';
+    return result;
 }
 
-bool TimerService::delete_timer(long handle) {
-    return _impl->delete_timer(handle);
 }
 
-void TimerService::update_timer(long handle, long interval) {
-    _impl->update_timer(handle, interval);
-}
-
-TimerService::TimerService()
-    : _impl { new Impl() }
-{}
-
-TimerService::~TimerService() = default;
+#pragma endregion // Parse
 
-#pragma endregion // Timer service
 
 class TelegramBot::Impl
 {
     void schedule_next_poll();
     void get_updates_async();
+    std::size_t process_updates(const rest::Response& r, bool replayed = false);
+    bool dispatch_update(BotUpdate&& update, bool replayed = false);
+    void handle_update(BotUpdate& update, UpdateClass cls, bool replayed);
+    template<typename T>
+    std::future<Result<T>> replay_sink(std::string_view method, T content);
+    SharedPtr<std::atomic<bool>> track_answer(const std::string& queryId, std::chrono::milliseconds deadline, std::function<void()> fallback);
+    SharedPtr<std::atomic<bool>> find_answer(const std::string& queryId);
+    SharedPtr<std::atomic<bool>> release_answer(const std::string& queryId);
+    void debounce_inline_query(BotUpdate&& update);
+    void cancel_query_timers();
+    void answer_fallback(const CallbackQuery& query);
+    void answer_fallback(const PreCheckoutQuery& query);
+    void write_offset(long offset);     // caller holds _offsetMutex
+    AllowedUpdates refresh_allowed_updates(std::string* query = nullptr);
+    void flush_sessions();
     void assert_if_not_logged() const;
 
+    void rest_get_async(const rest::Request& request, rest::Client::Callback cb);
+    void rest_post_async(const rest::Request& request, rest::Client::Callback cb);
+
+    int read_config_int(std::string_view key, int defaultValue) const;
+    std::size_t read_config_size(std::string_view key, std::size_t defaultValue) const;
+
     rest::Request createBotRestRequest();
 
 public:
 
-    Impl(TelegramBot& owner, config::Store config, mylog::LoggerPtr logger, UniquePtr<BotInteractionModuleBase> interaction);
+    Impl(TelegramBot& owner, BotHost* host, config::Store config, mylog::LoggerPtr logger, UniquePtr<BotInteractionModuleBase> interaction);
 
     Impl(const Impl&) = delete;
     Impl(Impl&&) = delete;
     Impl& operator=(const Impl&) = delete;
     Impl& operator=(Impl&&) = delete;
-    ~Impl() = default;
+    ~Impl();
 
     void begin_long_polling();
+    void start_long_polling();
+
+    void stop();
+    bool drain(std::chrono::steady_clock::time_point deadline);
+
+    bool handle_webhook_update(std::string_view payload);
+    ReplayStats replay(const std::filesystem::path& capture, ReplaySpeed speed);
 
     Future<Result<User>>      login_async();
     Future<Result<Message>>   send_message_async(const SendMessageParams& parms);
+    Future<Result<bool>>      set_webhook_async(const SetWebhookParams& parms);
+    Future<Result<bool>>      answer_callback_query_async(const AnswerCallbackQueryParams& parms);
+    Future<Result<bool>>      answer_pre_checkout_query_async(const AnswerPreCheckoutQueryParams& parms);
+    Future<Result<bool>>      answer_inline_query_async(const AnswerInlineQueryParams& parms);
 
     [[nodiscard]] const User& get_profile() const;
     [[nodiscard]] const config::Store& get_config() const;
     [[nodiscard]] TimerService& get_timer_service() const;
+    [[nodiscard]] SessionStore& get_session_store() const;
+    [[nodiscard]] DispatchMetrics get_dispatch_metrics() const;
+    [[nodiscard]] bool is_saturated() const;
 
 private:
 
+    // owned only by standalone bot, must outlive everything running on it
+    UniquePtr<BotHost> _ownedHost { nullptr };
+    BotHost* _host { nullptr };
+
+
+    std::mutex _stateMutex;
     std::condition_variable _isTerminating;
+    std::atomic<bool> _isStopping { false };
+    bool _isStopped { false };
 
     std::string _token;
     std::string _gateway;
@@ -352,29 +164,69 @@ private:
     config::Store _config;
 
     UniquePtr<boost::asio::steady_timer> _getUpdatesTimer { nullptr };
-    UniquePtr<rest::Client> _restClient { nullptr };
+    rest::Client* _restClient { nullptr };
     UniquePtr<BotInteractionModuleBase> _botInteraction { nullptr };
-    UniquePtr<TimerService> _timerService { nullptr };
+    TimerService* _timerService { nullptr };
+    UniquePtr<UpdateDispatcher> _dispatcher { nullptr };
+    UniquePtr<UpdateRecorder> _recorder { nullptr };
+
+    struct PendingAnswer {
+        SharedPtr<std::atomic<bool>> Answered;
+        SharedPtr<boost::asio::steady_timer> Deadline;
+    };
+
+    // queries which must be answered before Telegram gives up on them
+    std::mutex _answersMutex;
+    std::unordered_map<std::string, PendingAnswer> _pendingAnswers;
+    std::chrono::milliseconds _callbackAnswerDeadline { 1500 };
+    std::chrono::milliseconds _preCheckoutAnswerDeadline { 8000 };
+
+    // last inline query of every user waits for the debounce delay, newer query of the user supersedes it
+    std::mutex _inlineMutex;
+    std::unordered_map<long, SharedPtr<boost::asio::steady_timer>> _debouncedInlineQueries;
+    std::chrono::milliseconds _inlineQueryDebounce { 300 };
 
-    std::thread _workerThread;
-    boost::asio::io_context _ioCtx;
+    // shared with the flush timer, which may still be running while bot is destroyed
+    SharedPtr<SessionStore> _sessions { nullptr };
+    TimerHandle _sessionsTimer;
 
     mylog::LoggerPtr _logger { nullptr };
     TelegramBot* _interface { nullptr };
 
+    // late getUpdates or webhook callback may race with drain, which saves the final offset
+    std::mutex _offsetMutex;
+    bool _isOffsetSaved { false };
     std::fstream _tmpFile;
+    std::filesystem::path _offsetPath;
     User _profile;
 
-    long _lastReceivedUpdate { 0 };
+    std::atomic<long> _lastReceivedUpdate { 0 };
     int _longPollInterval { 5 };
+    int _updatesLimit { 100 };
+
+    // module may enable handlers after construction (e.g. in post_login), so the mask is read again before requests
+    std::mutex _allowedMutex;
+    std::atomic<UpdateTypeMask> _allowedMask { 0 };
+    std::string _allowedUpdatesQuery;
 
     bool _isLongPolling { false };
     bool _isLogged { false };
+    std::atomic<bool> _pollPaused { false };
+    std::atomic<int> _inFlightRequests { 0 };
+    std::atomic<int> _pendingCallbacks { 0 };   // armed timers and posted handlers which capture the bot
+
+    // replies of replayed updates are sent by their handlers on this thread, they go to the sink instead of Telegram
+    inline static thread_local const Impl* _replayingBot { nullptr };
+    std::atomic<std::size_t> _suppressedRequests { 0 };
 };
 
 
 TelegramBot::TelegramBot(config::Store config, std::unique_ptr<BotInteractionModuleBase> interaction)
-    : _impl{ new Impl(*this, std::move(config), mylog::LogManager::get().create_logger("Bot"), std::move(interaction)) }
+    : _impl{ new Impl(*this, nullptr, std::move(config), mylog::LogManager::get().create_logger("Bot"), std::move(interaction)) }
+{}
+
+TelegramBot::TelegramBot(BotHost& host, config::Store config, UniquePtr<BotInteractionModuleBase> interaction)
+    : _impl{ new Impl(*this, &host, std::move(config), mylog::LogManager::get().create_logger("Bot"), std::move(interaction)) }
 {}
 
 Future<Result<User>> TelegramBot::login_async() {
@@ -392,10 +244,46 @@ Future<Result<Message>> TelegramBot::send_message_async(const ChatId& chatId, st
     return send_message_async(p);
 }
 
+Future<Result<bool>> TelegramBot::set_webhook_async(const SetWebhookParams& parms) {
+    return _impl->set_webhook_async(parms);
+}
+
+Future<Result<bool>> TelegramBot::answer_callback_query_async(const AnswerCallbackQueryParams& parms) {
+    return _impl->answer_callback_query_async(parms);
+}
+
+Future<Result<bool>> TelegramBot::answer_pre_checkout_query_async(const AnswerPreCheckoutQueryParams& parms) {
+    return _impl->answer_pre_checkout_query_async(parms);
+}
+
+Future<Result<bool>> TelegramBot::answer_inline_query_async(const AnswerInlineQueryParams& parms) {
+    return _impl->answer_inline_query_async(parms);
+}
+
 void TelegramBot::begin_long_polling() {
     _impl->begin_long_polling();
 }
 
+void TelegramBot::start_long_polling() {
+    _impl->start_long_polling();
+}
+
+void TelegramBot::stop() {
+    _impl->stop();
+}
+
+bool TelegramBot::drain(std::chrono::steady_clock::time_point deadline) {
+    return _impl->drain(deadline);
+}
+
+bool TelegramBot::handle_webhook_update(std::string_view payload) {
+    return _impl->handle_webhook_update(payload);
+}
+
+ReplayStats TelegramBot::replay(const std::filesystem::path& capture, ReplaySpeed speed) {
+    return _impl->replay(capture, speed);
+}
+
 const User& TelegramBot::get_profile() const {
     return _impl->get_profile();
 }
@@ -408,6 +296,18 @@ TimerService& TelegramBot::get_timer_service() const {
     return _impl->get_timer_service();
 }
 
+SessionStore& TelegramBot::get_session_store() const {
+    return _impl->get_session_store();
+}
+
+DispatchMetrics TelegramBot::get_dispatch_metrics() const {
+    return _impl->get_dispatch_metrics();
+}
+
+bool TelegramBot::is_saturated() const {
+    return _impl->is_saturated();
+}
+
 TelegramBot::~TelegramBot() {
 
 }
@@ -416,15 +316,15 @@ TelegramBot::~TelegramBot() {
 
 TelegramBot::Impl::Impl(
       TelegramBot& owner
+    , BotHost* host
     , config::Store config
     , mylog::LoggerPtr logger
     , UniquePtr<BotInteractionModuleBase> interaction
 )
-    : _config{ std::move(config) }
+    : _host{ host }
+    , _config{ std::move(config) }
     , _botInteraction{ std::move(interaction) }
     , _logger{ logger }
-    , _timerService{ make_unique<TimerService>() }
-    , _restClient{ make_unique<rest::Client>() }
     , _interface{ &owner }
 {
     namespace asio = boost::asio;
@@ -440,17 +340,49 @@ TelegramBot::Impl::Impl(
         throw std::runtime_error("Telegram gateway was not found in configuration");
     }
 
-    int numThreads;
+    DispatcherOptions dispatch;
     {
-        try {
-            numThreads = std::stoi(_config["Telegram::Threads"].data());
-        } catch (const std::invalid_argument& e) {
-            _logger->error("Exception while configuring bot: {} (received: {})", e.what(),
-                           _config["Telegram::Threads"]);
-            throw e;
+        dispatch.HighWatermark = read_config_size("Telegram::Dispatch::HighWatermark", dispatch.HighWatermark);
+        dispatch.LowWatermark = read_config_size("Telegram::Dispatch::LowWatermark", dispatch.LowWatermark);
+        dispatch.Workers = read_config_size("Telegram::Dispatch::Workers", dispatch.Workers);
+        dispatch.CallbackQueryWorkers = read_config_size("Telegram::Dispatch::CallbackWorkers", dispatch.CallbackQueryWorkers);
+        dispatch.PreCheckoutQueryWorkers = read_config_size("Telegram::Dispatch::PreCheckoutWorkers", dispatch.PreCheckoutQueryWorkers);
+        dispatch.InlineQueryWorkers = read_config_size("Telegram::Dispatch::InlineWorkers", dispatch.InlineQueryWorkers);
+
+        const std::string_view shedding = _config["Telegram::Dispatch::Shedding"];
+        if (shedding == "drop") {
+            dispatch.Shedding = SheddingPolicy::DROP;
+        } else if (shedding == "defer") {
+            dispatch.Shedding = SheddingPolicy::DEFER;
+        } else if (!shedding.empty() && shedding != "none") {
+            throw std::runtime_error(fmt::format(R"(Unknown shedding policy "{}")", shedding));
+        }
+    }
+
+    if (_host == nullptr) {
+        int numThreads;
+        {
+            try {
+                numThreads = std::stoi(_config["Telegram::Threads"].data());
+            } catch (const std::invalid_argument& e) {
+                _logger->error("Exception while configuring bot: {} (received: {})", e.what(),
+                               _config["Telegram::Threads"]);
+                throw e;
+            }
         }
+
+        // own host runs every lane worker of the bot on a thread of its own
+        const std::size_t queryThreads = std::max<std::size_t>(dispatch.CallbackQueryWorkers, 1)
+            + std::max<std::size_t>(dispatch.PreCheckoutQueryWorkers, 1)
+            + std::max<std::size_t>(dispatch.InlineQueryWorkers, 1);
+        _ownedHost = make_unique<BotHost>(1, numThreads, queryThreads);
+        _host = _ownedHost.get();
     }
 
+    _restClient = &_host->get_rest_client();
+    _timerService = &_host->get_timer_service();
+    _getUpdatesTimer = make_unique<boost::asio::steady_timer>(_host->get_io_context().get_executor());
+
     int longPollInterval;
     {
         try {
@@ -464,8 +396,142 @@ TelegramBot::Impl::Impl(
         }
     }
 
+    {
+        try {
+            auto limit = _config["Telegram::LongPolling::Limit"];
+            if (!limit.empty()) {
+                // Bot API accepts values between 1 and 100
+                _updatesLimit = std::clamp(std::stoi(limit.data()), 1, 100);
+            }
+        } catch (const std::invalid_argument& e) {
+            _logger->error("Exception while configuring bot: {} (received: {})", e.what(), _config["Telegram::LongPolling::Limit"]);
+            throw e;
+        }
+    }
+
+    _callbackAnswerDeadline = std::chrono::milliseconds(
+        read_config_int("Telegram::Dispatch::CallbackAnswerDeadline", (int)_callbackAnswerDeadline.count()));
+    _preCheckoutAnswerDeadline = std::chrono::milliseconds(
+        read_config_int("Telegram::Dispatch::PreCheckoutAnswerDeadline", (int)_preCheckoutAnswerDeadline.count()));
+    _inlineQueryDebounce = std::chrono::milliseconds(
+        read_config_int("Telegram::Dispatch::InlineQueryDebounce", (int)_inlineQueryDebounce.count()));
+
+    const std::chrono::milliseconds sessionTtl{ read_config_int("Telegram::Sessions::Ttl", 1800000) };
+    const TimerDuration sessionFlush{ read_config_int("Telegram::Sessions::FlushInterval", 5000) };
+    _sessions = make_shared<SessionStore>(sessionTtl);
+    if (const std::string_view sessionDatabase = _config["Telegram::Sessions::Database"]; !sessionDatabase.empty()) {
+        _sessions->open_store(sessionDatabase);
+        _logger->info(R"(Sessions are stored in "{}", {} loaded)", sessionDatabase, _sessions->size());
+    }
+    // flush and eviction may be late, so they are grouped with other timers
+    _sessionsTimer = _timerService->add_timer([sessions = _sessions, logger = _logger](TimerReply&) {
+        try {
+            sessions->flush();
+            sessions->evict_expired();
+        } catch (const std::exception& e) {
+            logger->error("Exception occurred while flushing sessions: {}", e.what());
+        }
+    }, sessionFlush, /*looping*/ true, sessionFlush);
+
+    _dispatcher = make_unique<UpdateDispatcher>(_host->get_io_context().get_executor(), _host->get_query_pool().get_executor(), dispatch,
+                                                [this](BotUpdate& u, UpdateClass c, bool replayed) {
+        handle_update(u, c, replayed);
+    });
+    _dispatcher->set_resume_callback([this] {
+        if (_pollPaused.exchange(false) && !_isStopping) {
+            _logger->info("Handlers are drained, resuming long polling");
+            get_updates_async();
+        }
+    });
+
+    const std::string_view capturePath = _config["Telegram::Capture::Path"];
+    if (!capturePath.empty()) {
+        const auto path = util::get_executable_path() / capturePath;
+        _recorder = make_unique<UpdateRecorder>(path);
+        _logger->info(R"(Recording updates to "{}")", path);
+    }
+
+    refresh_allowed_updates();
+
     _logger->info("Gateway: {}", _gateway);
     _logger->info("Long-Polling interval: {}s", _longPollInterval);
+    _logger->info("Long-Polling limit: {}", _updatesLimit);
+    _logger->info("Dispatch watermarks: {}/{} workers = {}", dispatch.HighWatermark, dispatch.LowWatermark, dispatch.Workers);
+    _logger->info("Query lanes: callback workers = {} deadline = {}ms, pre-checkout workers = {} deadline = {}ms",
+                  dispatch.CallbackQueryWorkers, _callbackAnswerDeadline.count(),
+                  dispatch.PreCheckoutQueryWorkers, _preCheckoutAnswerDeadline.count());
+    _logger->info("Inline queries: workers = {} debounce = {}ms", dispatch.InlineQueryWorkers, _inlineQueryDebounce.count());
+    _logger->info("Sessions: ttl = {}ms flush = {}ms", sessionTtl.count(), sessionFlush.count());
+}
+
+int TelegramBot::Impl::read_config_int(std::string_view key, int defaultValue) const {
+    const std::string_view value = _config[key];
+    if (value.empty()) {
+        return defaultValue;
+    }
+
+    try {
+        return std::stoi(value.data());
+    } catch (const std::invalid_argument& e) {
+        _logger->error("Exception while configuring bot: {} (received: {})", e.what(), value);
+        throw e;
+    }
+}
+
+std::size_t TelegramBot::Impl::read_config_size(std::string_view key, std::size_t defaultValue) const {
+    // negative value would wrap to a huge limit and silently disable it
+    const int value = read_config_int(key, static_cast<int>(defaultValue));
+    if (value < 0) {
+        _logger->error("Exception while configuring bot: {} must not be negative (received: {})", key, value);
+        throw std::runtime_error(fmt::format(R"(invalid value of "{}": {})", key, value));
+    }
+    return static_cast<std::size_t>(value);
+}
+
+TelegramBot::Impl::~Impl() {
+    // bot which was not drained still has the poll timer, query timers and requests capturing it
+    stop();
+    _dispatcher->close();
+    cancel_query_timers();
+
+    if (_ownedHost) {
+        // callbacks which have not run yet are dropped with own threads
+        _ownedHost->shutdown();
+    } else {
+        // cancelled callbacks complete soon on threads of the shared host, stopped host never runs them
+        while (_host->is_running()
+               && (_inFlightRequests > 0 || _pendingCallbacks > 0 || !_dispatcher->is_idle())) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+
+    _timerService->delete_timer(_sessionsTimer);
+}
+
+void TelegramBot::Impl::rest_get_async(const rest::Request& request, rest::Client::Callback cb) {
+    ++_inFlightRequests;
+    _restClient->get_async(request, [this, cb = std::move(cb)](const rest::Response& r) {
+        try {
+            cb(r);
+        } catch (...) {
+            --_inFlightRequests;
+            throw;
+        }
+        --_inFlightRequests;
+    });
+}
+
+void TelegramBot::Impl::rest_post_async(const rest::Request& request, rest::Client::Callback cb) {
+    ++_inFlightRequests;
+    _restClient->post_async(request, [this, cb = std::move(cb)](const rest::Response& r) {
+        try {
+            cb(r);
+        } catch (...) {
+            --_inFlightRequests;
+            throw;
+        }
+        --_inFlightRequests;
+    });
 }
 
 rest::Request TelegramBot::Impl::createBotRestRequest() {
@@ -492,70 +558,55 @@ std::future<Result<User>> TelegramBot::Impl::login_async()
 
                 _profile = *profile.content();
                 _botInteraction->post_login(*_interface);
+                refresh_allowed_updates();
                 _isLogged = true;
-
-                promise->set_value(profile);
             } else {
                 _isLogged = false;
             }
+            promise->set_value(profile);
         } catch (const std::exception& e) {
             _isLogged = false;
+            promise->set_value(Result<User>::from_error(e.what()));
         }
     };
 
     rest::Request request = createBotRestRequest();
     request.segments().push_back("getMe");
 
-    _restClient->get_async(request, loginComplete);
+    rest_get_async(request, loginComplete);
 
     return promise->get_future();
 }
 
 void TelegramBot::Impl::get_updates_async() {
+    // timer or resume callback may fire after drain has started
+    if (_isStopping) {
+        return;
+    }
     assert_if_not_logged();
 
-    using Updates = Result<std::vector<BotUpdate>>;
     rest::Request request = createBotRestRequest();
     request.segments().push_back("getUpdates");
     request.params().set("offset", std::to_string(_lastReceivedUpdate + 1));
+    request.params().set("limit", std::to_string(_updatesLimit));
+    std::string allowedQuery;
+    refresh_allowed_updates(&allowedQuery);
+    request.params().set("allowed_updates", allowedQuery);
 
-    _restClient->get_async(request, [this](const rest::Response& r) {
+    rest_get_async(request, [this](const rest::Response& r) {
         try {
-            auto updatesResult = parse::do_parse<Updates>(r.get_json()->GetObj());
-            if (!updatesResult) {
-                _logger->error("getUpdates error: {}", *updatesResult.error());
-            } else {
-                std::vector<BotUpdate>& updates = *updatesResult.content();
-                const long prevUpdate = _lastReceivedUpdate;
-
-                for (auto&& upd: updates) {
-                    if (upd.UpdateType == BotUpdate::MESSAGE) {
-                        bool commandHandled = false;
-
-                        Message& messageData = upd.UpdateData.Message;
-                        auto interaction = make_unique<BotInteraction>(*_interface, messageData);
-
-                        for (const MessageEntity& messageEntity: messageData.Entites) {
-                            if (messageEntity.Type == MessageEntity::BOT_COMMAND) {
-                                _botInteraction->execute_interaction(std::move(interaction));
-                                commandHandled = true;
-                                break;
-                            }
-                        }
-
-                        if (!commandHandled) {
-                            _botInteraction->receive_message(std::move(interaction));
-                        }
-                    }
-                }
-
-                if (_lastReceivedUpdate != prevUpdate) {
-                    _tmpFile << _lastReceivedUpdate;
-                    _tmpFile.seekp(0);
-                    std::flush(_tmpFile);
-
-                    _logger->info("Last received update = {}", _lastReceivedUpdate);
-                }
+            if (_recorder) {
+                _recorder->append(CaptureRecord::GET_UPDATES, r.get_content());
+            }
+
+            const long prevUpdate = _lastReceivedUpdate;
+            process_updates(r);
+
+            const long lastUpdate = _lastReceivedUpdate;
+            if (lastUpdate != prevUpdate) {
+                std::unique_lock lock{ _offsetMutex };
+                write_offset(lastUpdate);
+                _logger->info("Last received update = {}", lastUpdate);
             }
         } catch(const std::exception& e) {
             _logger->error("Exception occurred while processing updates: {}", e.what());
@@ -565,7 +616,448 @@ void TelegramBot::Impl::get_updates_async() {
     });
 }
 
+std::size_t TelegramBot::Impl::process_updates(const rest::Response& r, bool replayed) {
+    using Updates = Result<std::vector<BotUpdate>>;
+
+    auto updatesResult = parse::do_parse<Updates>(r.get_json()->GetObj());
+    if (!updatesResult) {
+        _logger->error("getUpdates error: {}", *updatesResult.error());
+        return 0;
+    }
+
+    std::size_t numDispatched = 0;
+    for (auto&& upd: *updatesResult.content()) {
+        if (dispatch_update(std::move(upd), replayed)) {
+            ++numDispatched;
+        }
+    }
+    return numDispatched;
+}
+
+bool TelegramBot::Impl::dispatch_update(BotUpdate&& upd, bool replayed) {
+    // offset is owned by the update source, replay runs on another thread and must not acknowledge live updates
+    std::unique_lock<std::mutex> offsetLock;
+    if (!replayed) {
+        offsetLock = std::unique_lock{ _offsetMutex };
+        if (_isOffsetSaved) {
+            return false; // received after drain, it will be received again after restart
+        }
+        // offset moves together with dispatching, so drain never saves it past an update it has not seen
+        if (upd.Id > _lastReceivedUpdate) {
+            _lastReceivedUpdate = upd.Id;
+        }
+    }
+
+    if (!(_allowedMask.load(std::memory_order_relaxed) & update_type_bit(upd.UpdateType))) {
+        return false;
+    }
+
+    if (upd.UpdateType == BotUpdate::MESSAGE) {
+        const Message& messageData = upd.UpdateData.Message;
+        const bool isCommand = std::any_of(messageData.Entites.begin(), messageData.Entites.end(), [](const MessageEntity& e) {
+            return e.Type == MessageEntity::BOT_COMMAND;
+        });
+
+        return _dispatcher->push(std::move(upd), isCommand ? UpdateClass::COMMAND : UpdateClass::MESSAGE, replayed);
+    }
+
+    // replayed queries expired long ago, nobody waits for their answers
+    if (upd.UpdateType == BotUpdate::CALLBACK_QUERY) {
+        if (!replayed) {
+            const CallbackQuery query = upd.UpdateData.CallbackQuery;
+            track_answer(query.Id, _callbackAnswerDeadline, [this, query] {
+                _logger->warn(R"(Callback query "{}" was not answered in time)", query.Id);
+                answer_fallback(query);
+            });
+        }
+        return _dispatcher->push(std::move(upd), UpdateClass::CALLBACK_QUERY, replayed);
+    }
+
+    if (upd.UpdateType == BotUpdate::PRE_CHECKOUT_QUERY) {
+        if (!replayed) {
+            const PreCheckoutQuery query = upd.UpdateData.PreCheckoutQuery;
+            track_answer(query.Id, _preCheckoutAnswerDeadline, [this, query] {
+                _logger->warn(R"(Pre-checkout query "{}" was not answered in time)", query.Id);
+                answer_fallback(query);
+            });
+        }
+        return _dispatcher->push(std::move(upd), UpdateClass::PRE_CHECKOUT_QUERY, replayed);
+    }
+
+    if (upd.UpdateType == BotUpdate::INLINE_QUERY) {
+        if (_inlineQueryDebounce.count() <= 0 || replayed) {
+            return _dispatcher->push(std::move(upd), UpdateClass::INLINE_QUERY, replayed);
+        }
+        debounce_inline_query(std::move(upd));
+        return true;
+    }
+
+    return false;
+}
+
+void TelegramBot::Impl::debounce_inline_query(BotUpdate&& update) {
+    const long userId = update.UpdateData.InlineQuery.From.Id;
+    auto timer = make_shared<boost::asio::steady_timer>(_host->get_query_timer_pool().get_executor(), _inlineQueryDebounce);
+
+    {
+        std::unique_lock lock{ _inlineMutex };
+        auto& pending = _debouncedInlineQueries[userId];
+        if (pending) {
+            // user has typed further, the waiting query is superseded
+            boost::asio::post(pending->get_executor(), [superseded = pending] {
+                superseded->cancel();
+            });
+        }
+        pending = timer;
+    }
+
+    ++_pendingCallbacks;
+    timer->async_wait([this, userId, timer, upd = std::move(update)](const system::error_code& ec) mutable {
+        bool isLatest = false;
+        if (!ec) {
+            std::unique_lock lock{ _inlineMutex };
+            auto it = _debouncedInlineQueries.find(userId);
+            // query may be superseded while the handler was being posted
+            if (it != _debouncedInlineQueries.end() && it->second == timer) {
+                _debouncedInlineQueries.erase(it);
+                isLatest = true;
+            }
+        }
+        if (isLatest) {
+            _dispatcher->push(std::move(upd), UpdateClass::INLINE_QUERY);
+        }
+        --_pendingCallbacks;
+    });
+}
+
+void TelegramBot::Impl::cancel_query_timers() {
+    {
+        std::unique_lock lock{ _answersMutex };
+        for (auto& [id, pending] : _pendingAnswers) {
+            boost::asio::post(pending.Deadline->get_executor(), [timer = pending.Deadline] {
+                timer->cancel();
+            });
+        }
+        _pendingAnswers.clear();
+    }
+    {
+        std::unique_lock lock{ _inlineMutex };
+        for (auto& [userId, timer] : _debouncedInlineQueries) {
+            boost::asio::post(timer->get_executor(), [timer = timer] {
+                timer->cancel();
+            });
+        }
+        _debouncedInlineQueries.clear();
+    }
+}
+
+SharedPtr<std::atomic<bool>> TelegramBot::Impl::track_answer(
+      const std::string& queryId
+    , std::chrono::milliseconds deadline
+    , std::function<void()> fallback
+)
+{
+    auto answered = make_shared<std::atomic<bool>>(false);
+    auto timer = make_shared<boost::asio::steady_timer>(_host->get_query_timer_pool().get_executor(), deadline);
+
+    {
+        std::unique_lock lock{ _answersMutex };
+        _pendingAnswers[queryId] = PendingAnswer{ answered, timer };
+    }
+
+    // deadline is counted from receiving, so the query is answered even if its lane is backed up or its handler is slow
+    ++_pendingCallbacks;
+    timer->async_wait([this, queryId, answered, fallback = std::move(fallback)](const system::error_code& ec) {
+        if (!ec && !answered->exchange(true)) {
+            release_answer(queryId);
+            fallback();
+        }
+        --_pendingCallbacks;
+    });
+
+    return answered;
+}
+
+SharedPtr<std::atomic<bool>> TelegramBot::Impl::find_answer(const std::string& queryId) {
+    std::unique_lock lock{ _answersMutex };
+    auto it = _pendingAnswers.find(queryId);
+    return it == _pendingAnswers.end() ? nullptr : it->second.Answered;
+}
+
+SharedPtr<std::atomic<bool>> TelegramBot::Impl::release_answer(const std::string& queryId) {
+    std::unique_lock lock{ _answersMutex };
+    auto it = _pendingAnswers.find(queryId);
+    if (it == _pendingAnswers.end()) {
+        return nullptr;
+    }
+
+    auto answered = it->second.Answered;
+    boost::asio::post(it->second.Deadline->get_executor(), [timer = it->second.Deadline] {
+        timer->cancel();
+    });
+    _pendingAnswers.erase(it);
+    return answered;
+}
+
+void TelegramBot::Impl::answer_fallback(const CallbackQuery& query) {
+    AnswerCallbackQueryParams parms;
+    parms.CallbackQueryId = query.Id;
+    answer_callback_query_async(parms);
+}
+
+void TelegramBot::Impl::answer_fallback(const PreCheckoutQuery& query) {
+    AnswerPreCheckoutQueryParams parms;
+    parms.PreCheckoutQueryId = query.Id;
+    parms.Ok = false;
+    parms.ErrorMessage = "The bot could not confirm the order in time, please try again";
+    answer_pre_checkout_query_async(parms);
+}
+
+bool TelegramBot::Impl::handle_webhook_update(std::string_view payload) {
+    if (_dispatcher->is_paused()) {
+        return false;
+    }
+
+    if (_recorder) {
+        _recorder->append(CaptureRecord::WEBHOOK, payload);
+    }
+
+    try {
+        rest::Response r{ std::string{ payload } };
+        dispatch_update(parse::do_parse<BotUpdate>(r.get_json()->GetObj()));
+    } catch (const std::exception& e) {
+        _logger->error("Exception occurred while processing webhook update: {}", e.what());
+    }
+    return true;
+}
+
+ReplayStats TelegramBot::Impl::replay(const std::filesystem::path& capture, ReplaySpeed speed) {
+    namespace chrono = std::chrono;
+
+    CaptureReader reader{ capture };
+    ReplayStats stats;
+    const std::size_t suppressedBefore = _suppressedRequests;
+
+    _logger->info(R"(Replaying capture "{}")", capture);
+
+    const auto start = chrono::steady_clock::now();
+    std::optional<chrono::microseconds> firstReceivedAt;
+
+    CaptureRecord record;
+    while (reader.next(record)) {
+        if (!firstReceivedAt) {
+            firstReceivedAt = record.ReceivedAt;
+        }
+
+        if (speed == ReplaySpeed::ORIGINAL) {
+            std::this_thread::sleep_until(start + (record.ReceivedAt - *firstReceivedAt));
+        }
+
+        // respect backpressure the same way long polling does
+        while (_dispatcher->is_paused()) {
+            std::this_thread::sleep_for(chrono::milliseconds(1));
+        }
+
+        try {
+            rest::Response r{ std::move(record.Payload) };
+            if (record.Type == CaptureRecord::GET_UPDATES) {
+                stats.Updates += process_updates(r, /*replayed*/ true);
+            } else if (dispatch_update(parse::do_parse<BotUpdate>(r.get_json()->GetObj()), /*replayed*/ true)) {
+                ++stats.Updates;
+            }
+        } catch (const std::exception& e) {
+            _logger->error("Exception occurred while replaying updates: {}", e.what());
+        }
+        ++stats.Records;
+    }
+
+    // wait until all replayed updates are handled
+    while (true) {
+        const auto metrics = _dispatcher->get_metrics();
+        if (metrics.QueueDepth == 0 && metrics.DeferredDepth == 0 && metrics.Running == 0) {
+            break;
+        }
+        std::this_thread::sleep_for(chrono::milliseconds(1));
+    }
+
+    stats.Elapsed = chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - start);
+    stats.Suppressed = _suppressedRequests - suppressedBefore;
+
+    _logger->info("Replayed {} records ({} updates) in {}ms, {} requests suppressed",
+                  stats.Records, stats.Updates, stats.Elapsed.count(), stats.Suppressed);
+    return stats;
+}
+
+void TelegramBot::Impl::handle_update(BotUpdate& update, UpdateClass cls, bool replayed) {
+    // workers of the shared host run other bots as well, so the previous value is restored
+    struct ReplayScope {
+        const Impl*& Current;
+        const Impl* Previous;
+        ~ReplayScope() { Current = Previous; }
+    } replayScope{ _replayingBot, std::exchange(_replayingBot, replayed ? this : nullptr) };
+
+    if (update.UpdateType == BotUpdate::MESSAGE) {
+        const BotInteraction interaction{ *_interface, update.UpdateData.Message };
+        if (cls == UpdateClass::COMMAND) {
+            _botInteraction->execute_interaction(interaction);
+        } else {
+            _botInteraction->receive_message(interaction);
+        }
+    } else if (update.UpdateType == BotUpdate::CALLBACK_QUERY) {
+        const CallbackQuery& query = update.UpdateData.CallbackQuery;
+        auto answered = replayed ? make_shared<std::atomic<bool>>(false) : find_answer(query.Id);
+        if (!answered) {
+            return; // deadline has already expired
+        }
+
+        // deadline stays armed while handler runs, whichever answers first wins
+        CallbackQueryInteraction interaction{ *_interface, query, answered };
+        _botInteraction->receive_callback_query(interaction);
+        if (replayed) {
+            return;
+        }
+        release_answer(query.Id);
+        if (!answered->exchange(true)) {
+            answer_fallback(query);
+        }
+    } else if (update.UpdateType == BotUpdate::INLINE_QUERY) {
+        const InlineQueryInteraction interaction{ *_interface, update.UpdateData.InlineQuery };
+        _botInteraction->receive_inline_query(interaction);
+    } else if (update.UpdateType == BotUpdate::PRE_CHECKOUT_QUERY) {
+        const PreCheckoutQuery& query = update.UpdateData.PreCheckoutQuery;
+        auto answered = replayed ? make_shared<std::atomic<bool>>(false) : find_answer(query.Id);
+        if (!answered) {
+            return; // deadline has already expired
+        }
+
+        PreCheckoutQueryInteraction interaction{ *_interface, query, answered };
+        _botInteraction->receive_pre_checkout_query(interaction);
+        if (replayed) {
+            return;
+        }
+        release_answer(query.Id);
+        if (!answered->exchange(true)) {
+            _logger->warn(R"(Pre-checkout query "{}" was not answered by handler)", query.Id);
+            answer_fallback(query);
+        }
+    }
+}
+
+AllowedUpdates TelegramBot::Impl::refresh_allowed_updates(std::string* query) {
+    AllowedUpdates allowed;
+    allowed.Mask = _botInteraction->get_update_mask();
+
+    std::unique_lock lock{ _allowedMutex };
+    if (allowed.Mask != _allowedMask.load(std::memory_order_relaxed) || _allowedUpdatesQuery.empty()) {
+        _allowedMask.store(allowed.Mask, std::memory_order_relaxed);
+        _allowedUpdatesQuery = parse::to_query_value(allowed);
+        _logger->info("Allowed updates: {}", _allowedUpdatesQuery);
+    }
+    if (query) {
+        *query = _allowedUpdatesQuery;
+    }
+    return allowed;
+}
+
+void TelegramBot::Impl::write_offset(long offset) {
+    if (_tmpFile.is_open()) {
+        _tmpFile << offset;
+        _tmpFile.seekp(0);
+        std::flush(_tmpFile);
+    }
+}
+
 void TelegramBot::Impl::begin_long_polling() {
+    start_long_polling();
+
+    {
+        std::unique_lock lock{ _stateMutex };
+        _isTerminating.wait(lock, [this] {
+            return _isStopped;
+        });
+    }
+}
+
+void TelegramBot::Impl::stop() {
+    if (_isStopping.exchange(true)) {
+        return;
+    }
+
+    _logger->info("Stopping updates");
+
+    // timer is used from the io context only
+    ++_pendingCallbacks;
+    boost::asio::post(_getUpdatesTimer->get_executor(), [this] {
+        _getUpdatesTimer->cancel();
+        --_pendingCallbacks;
+    });
+}
+
+bool TelegramBot::Impl::drain(std::chrono::steady_clock::time_point deadline) {
+    namespace chrono = std::chrono;
+
+    stop();
+
+    // getUpdates in flight may still add updates to the dispatcher, and handlers may send requests,
+    // so both must be idle at the same time
+    bool drained = false;
+    while (true) {
+        if (_inFlightRequests == 0 && _dispatcher->is_idle()) {
+            drained = true;
+            break;
+        }
+        if (chrono::steady_clock::now() >= deadline) {
+            break;
+        }
+        std::this_thread::sleep_for(chrono::milliseconds(5));
+    }
+
+    {
+        // callbacks which are still in flight after deadline can neither dispatch nor move the saved offset
+        std::unique_lock lock{ _offsetMutex };
+        _isOffsetSaved = true;
+        const auto oldestPending = _dispatcher->close();
+
+        if (_isLongPolling) {
+            // updates which were not handled will be received again after restart
+            const long lastUpdate = _lastReceivedUpdate;
+            const long offset = oldestPending ? std::min(lastUpdate, *oldestPending - 1) : lastUpdate;
+
+            _tmpFile.close();
+            _tmpFile.open(_offsetPath, std::ios_base::out | std::ios_base::trunc);
+            write_offset(offset);
+            _tmpFile.close();
+
+            _logger->info("Saved update offset = {}", offset);
+        }
+    }
+
+    // queries of discarded updates are received again after restart, nothing may fire into stopped bot
+    cancel_query_timers();
+
+    // handlers have finished, sessions they changed are written before the bot goes down
+    _timerService->delete_timer(_sessionsTimer);
+    flush_sessions();
+
+    if (!drained) {
+        _logger->warn("Drain deadline exceeded: {} requests in flight", _inFlightRequests.load());
+    }
+
+    if (_ownedHost) {
+        _ownedHost->shutdown();
+    }
+
+    {
+        std::unique_lock lock{ _stateMutex };
+        _isStopped = true;
+    }
+    _isTerminating.notify_all();
+
+    _logger->info("Bot stopped (drained = {})", drained);
+    return drained;
+}
+
+void TelegramBot::Impl::start_long_polling() {
     assert_if_not_logged();
 
     if (_isLongPolling) {
@@ -582,7 +1074,8 @@ void TelegramBot::Impl::begin_long_polling() {
 
     fs::path basePath = util::get_executable_path();
     fs::path tempDirPath = basePath / "temp";
-    fs::path tgFile = tempDirPath / "poll.info";
+    fs::path tgFile = tempDirPath / fmt::format("poll_{}.info", _profile.Id); // bots may share the directory
+    _offsetPath = tgFile;
 
     if (!fs::exists(tempDirPath)) {
         fs::create_directories(tempDirPath);
@@ -597,29 +1090,19 @@ void TelegramBot::Impl::begin_long_polling() {
         std::ifstream  ifs;
         ifs.open(tgFile);
         if (!ifs.eof())  {
-            ifs >> _lastReceivedUpdate;
-            _logger->info("Read cache last update = {}", _lastReceivedUpdate);
+            long lastUpdate = 0;
+            ifs >> lastUpdate;
+            _lastReceivedUpdate = lastUpdate;
+            _logger->info("Read cache last update = {}", lastUpdate);
         }
     }
-    _tmpFile.open(tgFile, std::ios_base::out | std::ios_base::trunc );
-    _tmpFile << _lastReceivedUpdate;
-    _tmpFile.seekp(0);
-    std::flush(_tmpFile);
-
-    auto guard = boost::asio::make_work_guard(_ioCtx);
-    _getUpdatesTimer = std::make_unique<boost::asio::steady_timer>(_ioCtx.get_executor());
-
-    _workerThread = std::thread{ [this]{
-        _ioCtx.run();
-    } };
-
-    get_updates_async();
-
     {
-        std::mutex blockingMutex;
-        std::unique_lock lock(blockingMutex);
-        _isTerminating.wait(lock);
+        std::unique_lock lock{ _offsetMutex };
+        _tmpFile.open(tgFile, std::ios_base::out | std::ios_base::trunc );
+        write_offset(_lastReceivedUpdate);
     }
+
+    get_updates_async();
 }
 
 const User& TelegramBot::Impl::get_profile() const {
@@ -627,13 +1110,33 @@ const User& TelegramBot::Impl::get_profile() const {
 }
 
 void TelegramBot::Impl::schedule_next_poll() {
+    if (_isStopping) {
+        return;
+    }
+
+    if (_dispatcher->is_paused()) {
+        // flag is raised before the second check, so resume callback cannot miss it
+        _pollPaused = true;
+        if (_dispatcher->is_paused() || !_pollPaused.exchange(false)) {
+            _logger->warn("Handlers are saturated, long polling is paused");
+            return;
+        }
+    }
+
     if (_getUpdatesTimer->expires_from_now().count() <= 0) {
         _getUpdatesTimer->expires_from_now(std::chrono::seconds(_longPollInterval));
     }
+    ++_pendingCallbacks;
     _getUpdatesTimer->async_wait([this](const system::error_code& ec) {
-        if (!ec) {
-            get_updates_async();
+        try {
+            if (!ec && !_isStopping) {
+                get_updates_async();
+            }
+        } catch (...) {
+            --_pendingCallbacks;
+            throw;
         }
+        --_pendingCallbacks;
     });
 }
 
@@ -648,11 +1151,17 @@ std::future<Result<Message>> TelegramBot::Impl::send_message_async(const SendMes
         promise->set_value( Result<Message>::from_error("Message cannot be empty") );
         return promise->get_future();
     }
+    if (_replayingBot == this) {
+        Message message;
+        message.Chat.Id = parms.ChatId;
+        message.Text = parms.Text;
+        return replay_sink("sendMessage", std::move(message));
+    }
 
     rest::Request request = createBotRestRequest();
     request.segments().push_back("sendMessage");
     request.set_json_content(parms);
-    _restClient->post_async(request, [this, promise](const rest::Response& r) {
+    rest_post_async(request, [this, promise](const rest::Response& r) {
         auto result = parse::do_parse<Result<Message>>(r.get_json()->GetObj());
         if (!result) {
             _logger->error("sendMessage error: {}", *result.error());
@@ -664,6 +1173,96 @@ std::future<Result<Message>> TelegramBot::Impl::send_message_async(const SendMes
     return promise->get_future();
 }
 
+std::future<Result<bool>> TelegramBot::Impl::set_webhook_async(const SetWebhookParams& parms) {
+    auto promise = std::make_shared<std::promise<Result<bool>>>();
+
+    const AllowedUpdates allowed = parms.Allowed.value_or(refresh_allowed_updates());
+
+    JAlloc a;
+    rest::Request request = createBotRestRequest();
+    request.segments().push_back("setWebhook");
+    request.set_json_content(parse::do_parse(parms, allowed, parse::ParseTag<JValue>{}, a));
+    rest_post_async(request, [this, promise](const rest::Response& r) {
+        auto result = parse::do_parse<Result<bool>>(r.get_json()->GetObj());
+        if (!result) {
+            _logger->error("setWebhook error: {}", *result.error());
+        }
+        promise->set_value(std::move(result));
+    });
+
+    return promise->get_future();
+}
+
+std::future<Result<bool>> TelegramBot::Impl::answer_callback_query_async(const AnswerCallbackQueryParams& parms) {
+    if (_replayingBot == this) {
+        return replay_sink("answerCallbackQuery", true);
+    }
+    auto promise = std::make_shared<std::promise<Result<bool>>>();
+
+    rest::Request request = createBotRestRequest();
+    request.segments().push_back("answerCallbackQuery");
+    request.set_json_content(parms);
+    rest_post_async(request, [this, promise](const rest::Response& r) {
+        auto result = parse::do_parse<Result<bool>>(r.get_json()->GetObj());
+        if (!result) {
+            _logger->error("answerCallbackQuery error: {}", *result.error());
+        }
+        promise->set_value(std::move(result));
+    });
+
+    return promise->get_future();
+}
+
+std::future<Result<bool>> TelegramBot::Impl::answer_inline_query_async(const AnswerInlineQueryParams& parms) {
+    if (_replayingBot == this) {
+        return replay_sink("answerInlineQuery", true);
+    }
+    auto promise = std::make_shared<std::promise<Result<bool>>>();
+
+    rest::Request request = createBotRestRequest();
+    request.segments().push_back("answerInlineQuery");
+    request.set_json_content(parms);
+    rest_post_async(request, [this, promise](const rest::Response& r) {
+        auto result = parse::do_parse<Result<bool>>(r.get_json()->GetObj());
+        if (!result) {
+            _logger->error("answerInlineQuery error: {}", *result.error());
+        }
+        promise->set_value(std::move(result));
+    });
+
+    return promise->get_future();
+}
+
+std::future<Result<bool>> TelegramBot::Impl::answer_pre_checkout_query_async(const AnswerPreCheckoutQueryParams& parms) {
+    if (_replayingBot == this) {
+        return replay_sink("answerPreCheckoutQuery", true);
+    }
+    auto promise = std::make_shared<std::promise<Result<bool>>>();
+
+    rest::Request request = createBotRestRequest();
+    request.segments().push_back("answerPreCheckoutQuery");
+    request.set_json_content(parms);
+    rest_post_async(request, [this, promise](const rest::Response& r) {
+        auto result = parse::do_parse<Result<bool>>(r.get_json()->GetObj());
+        if (!result) {
+            _logger->error("answerPreCheckoutQuery error: {}", *result.error());
+        }
+        promise->set_value(std::move(result));
+    });
+
+    return promise->get_future();
+}
+
+template<typename T>
+std::future<Result<T>> TelegramBot::Impl::replay_sink(std::string_view method, T content) {
+    ++_suppressedRequests;
+    _logger->info("Replay: {} was not sent", method);
+
+    std::promise<Result<T>> promise;
+    promise.set_value(Result<T>::from_content(std::move(content)));
+    return promise.get_future();
+}
+
 const config::Store& TelegramBot::Impl::get_config() const {
     return _config;
 }
@@ -672,32 +1271,26 @@ TimerService& TelegramBot::Impl::get_timer_service() const {
     return *_timerService;
 }
 
-#pragma endregion // TgBot Implementation
-
-
-TimerReply::TimerReply(long handle)
-    : _handle{ handle } {
-
+SessionStore& TelegramBot::Impl::get_session_store() const {
+    return *_sessions;
 }
 
-void TimerReply::set_delete() {
-    consume_reply();
-    _delete = true;
+void TelegramBot::Impl::flush_sessions() {
+    try {
+        _sessions->flush();
+    } catch (const std::exception& e) {
+        _logger->error("Exception occurred while flushing sessions: {}", e.what());
+    }
 }
 
-void TimerReply::update_interval(long time) {
-    consume_reply();
-    _newIntervalMs = std::max(time, 1l);
+DispatchMetrics TelegramBot::Impl::get_dispatch_metrics() const {
+    return _dispatcher->get_metrics();
 }
 
-void TimerReply::consume_reply() {
-    assert(!_consumed);
-    _consumed = true;
+bool TelegramBot::Impl::is_saturated() const {
+    return _dispatcher->is_paused();
 }
 
-bool TimerReply::is_interval() const { return _newIntervalMs > 0; }
-bool TimerReply::is_delete() const { return _delete; }
-long TimerReply::interval() const { return _newIntervalMs; }
-long TimerReply::handle() const { return _handle; }
+#pragma endregion // TgBot Implementation
 
 }
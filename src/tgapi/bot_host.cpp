@@ -0,0 +1,226 @@
+#include "tgapi/bot/bot_host.h"
+
+#include "log/logging.h"
+
+#include <thread>
+#include <boost/asio/executor_work_guard.hpp>
+#include <boost/asio/thread_pool.hpp>
+
+namespace tg
+{
+
+class BotHost::Impl {
+public:
+
+    Impl(std::size_t numThreads, std::size_t numRestThreads, std::size_t numQueryThreads)
+        : _guard{ boost::asio::make_work_guard(_ioCtx) }
+        , _queryPool{ std::max<std::size_t>(numQueryThreads, 1) }
+        , _queryTimerPool{ 1 }
+        , _restClient{ make_unique<rest::Client>(numRestThreads) }
+        , _timerService{ make_unique<TimerService>(_ioCtx.get_executor()) }
+    {
+        _logger = mylog::LogManager::get().create_logger("Host");
+
+        numThreads = std::max<std::size_t>(numThreads, 1);
+        for (std::size_t i = 0; i < numThreads; ++i) {
+            _threads.emplace_back([this] {
+                _ioCtx.run();
+            });
+        }
+
+        _logger->info("Started host with {} io threads, {} query threads and {} rest threads",
+                      numThreads, std::max<std::size_t>(numQueryThreads, 1), numRestThreads);
+    }
+
+    Impl(const Impl&) = delete;
+    Impl(Impl&&) = delete;
+    Impl& operator=(const Impl&) = delete;
+    Impl& operator=(Impl&&) = delete;
+
+    ~Impl() {
+        shutdown();
+        _bots.clear();
+    }
+
+    void shutdown() {
+        std::unique_lock lock{ _shutdownMutex };
+        if (_isShutdown) {
+            return;
+        }
+        _isShutdown = true;
+
+        _guard.reset();
+        _ioCtx.stop();
+        for (auto& thread : _threads) {
+            if (thread.joinable()) {
+                thread.join();
+            }
+        }
+
+        // running query handlers are not interrupted, pending deadlines are dropped
+        _queryTimerPool.stop();
+        _queryPool.stop();
+        _queryTimerPool.join();
+        _queryPool.join();
+
+        _restClient->shutdown();
+        _timerService->shutdown();
+
+        {
+            std::unique_lock stateLock{ _mutex };
+            _isStopped = true;
+        }
+        _isTerminating.notify_all();
+    }
+
+    bool is_running() {
+        // waits for shutdown in progress, so no callback runs once this returns false
+        std::unique_lock lock{ _shutdownMutex };
+        return !_isShutdown;
+    }
+
+    bool drain(std::chrono::steady_clock::time_point deadline) {
+        std::vector<TelegramBot*> bots;
+        {
+            std::unique_lock lock{ _mutex };
+            for (auto& bot : _bots) {
+                bots.push_back(bot.get());
+            }
+        }
+
+        // stop ingestion everywhere first, so bots drain in parallel
+        for (auto* bot : bots) {
+            bot->stop();
+        }
+
+        bool drained = true;
+        for (auto* bot : bots) {
+            drained = bot->drain(deadline) && drained;
+        }
+
+        _logger->info("Host drained (complete = {})", drained);
+
+        shutdown();
+        return drained;
+    }
+
+    void add_bot(UniquePtr<TelegramBot> bot) {
+        std::unique_lock lock{ _mutex };
+        _bots.push_back(std::move(bot));
+    }
+
+    void run() {
+        std::vector<TelegramBot*> bots;
+        {
+            std::unique_lock lock{ _mutex };
+            for (auto& bot : _bots) {
+                bots.push_back(bot.get());
+            }
+        }
+
+        // logins are independent, so issue all of them before waiting
+        std::vector<Future<Result<User>>> logins;
+        logins.reserve(bots.size());
+        for (auto* bot : bots) {
+            logins.push_back(bot->login_async());
+        }
+
+        for (std::size_t i = 0; i < bots.size(); ++i) {
+            auto login = logins[i].get();
+            if (login.is_ok()) {
+                bots[i]->start_long_polling();
+            } else {
+                _logger->error("Bot login failed: {}", *login.error());
+            }
+        }
+
+        _logger->info("Running {} bots", bots.size());
+
+        {
+            std::unique_lock lock{ _mutex };
+            _isTerminating.wait(lock, [this] {
+                return _isStopped;
+            });
+        }
+    }
+
+    boost::asio::io_context& get_io_context() { return _ioCtx; }
+    boost::asio::thread_pool& get_query_pool() { return _queryPool; }
+    boost::asio::thread_pool& get_query_timer_pool() { return _queryTimerPool; }
+    rest::Client& get_rest_client() { return *_restClient; }
+    TimerService& get_timer_service() { return *_timerService; }
+
+private:
+    boost::asio::io_context _ioCtx;
+    boost::asio::executor_work_guard<boost::asio::io_context::executor_type> _guard;
+    std::vector<std::thread> _threads;
+
+    // priority lanes and query deadlines of all bots have threads of their own,
+    // so slow message handlers cannot hold them up
+    boost::asio::thread_pool _queryPool;
+    boost::asio::thread_pool _queryTimerPool;
+
+    UniquePtr<rest::Client> _restClient;
+    UniquePtr<TimerService> _timerService;
+
+    std::mutex _mutex;
+    std::condition_variable _isTerminating;
+    bool _isStopped { false };
+    std::vector<UniquePtr<TelegramBot>> _bots;
+
+    std::mutex _shutdownMutex;
+    bool _isShutdown { false };
+
+    mylog::LoggerPtr _logger { nullptr };
+};
+
+BotHost::BotHost(std::size_t numThreads, std::size_t numRestThreads, std::size_t numQueryThreads)
+    : _impl{ new Impl(numThreads, numRestThreads, numQueryThreads) }
+{}
+
+BotHost::~BotHost() = default;
+
+TelegramBot& BotHost::add_bot(config::Store config, UniquePtr<BotInteractionModuleBase> interaction) {
+    auto bot = make_unique<TelegramBot>(*this, std::move(config), std::move(interaction));
+    TelegramBot& ref = *bot;
+    _impl->add_bot(std::move(bot));
+    return ref;
+}
+
+void BotHost::run() {
+    _impl->run();
+}
+
+bool BotHost::drain(std::chrono::steady_clock::time_point deadline) {
+    return _impl->drain(deadline);
+}
+
+void BotHost::shutdown() {
+    _impl->shutdown();
+}
+
+bool BotHost::is_running() const {
+    return _impl->is_running();
+}
+
+boost::asio::io_context& BotHost::get_io_context() const {
+    return _impl->get_io_context();
+}
+
+boost::asio::thread_pool& BotHost::get_query_pool() const {
+    return _impl->get_query_pool();
+}
+
+boost::asio::thread_pool& BotHost::get_query_timer_pool() const {
+    return _impl->get_query_timer_pool();
+}
+
+rest::Client& BotHost::get_rest_client() const {
+    return _impl->get_rest_client();
+}
+
+TimerService& BotHost::get_timer_service() const {
+    return _impl->get_timer_service();
+}
+
+}
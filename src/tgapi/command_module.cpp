@@ -1,81 +1,86 @@
 #include "tgapi/command/command_module.h"
 
 #include "tgapi/bot/bot.h"
+#include "tgapi/bot/timer_service.h"
 
 #include "log/logging.h"
 
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <stdexcept>
+
+#include <fmt/format.h>
+
 namespace tg {
 
-bool parse_command_from_text(
-          const Message& m
-        , const TelegramBot& bot
-        , std::string& command
-        , std::string& args
-)
-{
-    command.clear();
-    args.clear();
+namespace {
+
+// completion of asynchronous handlers is checked this often, late checks only delay the log line
+constexpr TimerDuration PENDING_POLL_INTERVAL{ 10 };
+
+bool equals_ignore_case(std::string_view a, std::string_view b) {
+    return a.size() == b.size() && std::equal(a.begin(), a.end(), b.begin(), [](char x, char y) {
+        return std::tolower(static_cast<unsigned char>(x)) == std::tolower(static_cast<unsigned char>(y));
+    });
+}
+
+long session_chat_id(const ChatId& id) {
+    // received chats always have numeric ids, user names are only used for sending
+    const long* chat = std::get_if<long>(&id);
+    return chat ? *chat : 0;
+}
 
+}
+
+std::optional<CommandView> parse_command_from_text(const Message& m, std::string_view botName) {
     auto it = std::find_if(m.Entites.begin(), m.Entites.end(), [](const MessageEntity& e) {
         return e.Offset == 0 && e.Type == MessageEntity::BOT_COMMAND;
     });
+    if (it == m.Entites.end()) {
+        return std::nullopt;
+    }
 
-    if (it != m.Entites.end())
-    {
-        if (it->Length == 0) { return false; }
-
-        size_t offset = 0;
-        size_t length = it->Length;
+    // commands are ascii, so entity length (in UTF-16 units) is the length in bytes
+    const std::string_view text{ m.Text };
+    std::string_view entity = text.substr(0, std::min<std::size_t>(it->Length, text.size()));
 
-        while(length > 0 && m.Text[offset] == '/') {
-            ++offset;
-            --length;
-        }
+    while (!entity.empty() && entity.front() == '/') {
+        entity.remove_prefix(1);
+    }
+    if (entity.empty()) {
+        return std::nullopt;
+    }
 
-        const long mentionPos = m.Text.find('@');
-        if (mentionPos != std::string::npos) {
-            if (mentionPos + 1 == m.Text.length()) { // malformed mention like '/command@' where symbol is at end of str
-                return false;
-            }
-            // we have been mentioned
-            const std::string_view mention{ m.Text.c_str() + mentionPos + 1, m.Text.length() - mentionPos - 1 };
-            if (mention != bot.get_profile().UserName) { // command is not related to us
-                return false;
-            }
-            command = m.Text.substr(offset, mentionPos - 1); // substring until mention symbol
+    CommandView command;
+    command.Name = entity;
 
-        } else {
-            command = m.Text.substr(offset, length);
-        }
+    if (const auto mentionPos = entity.find('@'); mentionPos != std::string_view::npos) {
+        command.Name = entity.substr(0, mentionPos);
+        command.Mention = entity.substr(mentionPos + 1);
 
-        //
-        // example:
-        //
-        //  /cmd bar
-        //  command name ends at 'd' character, if we can step 2 chars forward, possibly we have arguments (char b)
-        if (offset + length + 1 <= m.Text.length()) {
-            // parse arguments
-            args = m.Text.substr(offset + length + 1);
+        // user names are case insensitive
+        if (command.Mention.empty() || !equals_ignore_case(command.Mention, botName)) {
+            return std::nullopt; // malformed mention or command is not related to us
         }
-
-        return true;
     }
 
-    return false;
-}
+    //
+    // example:
+    //
+    //  /cmd@bot bar
+    //  arguments start after the entity and the whitespace which follows it
+    std::string_view args = text.substr(entity.data() + entity.size() - text.data());
+    const auto argsStart = args.find_first_not_of(" \t\r\n");
+    command.Args = argsStart == std::string_view::npos ? std::string_view{} : args.substr(argsStart);
 
-bool parse_command_arguments(
-          const function::FunctionBase& func
-        , std::string_view arguments
-        , function::ArgumentList& args
-)
-{
-    return func.parse_arguments(arguments, /*out*/ args);
+    return command;
 }
 
 Future<Result<Message>> BotInteraction::reply_async(
     std::string_view text,
-    const MessageEntities* entities
+    const MessageEntities* entities,
+    const InlineKeyboardMarkup* markup
 ) const {
     SendMessageParams parms;
     parms.ChatId = _m.Chat.Id;
@@ -86,50 +91,333 @@ Future<Result<Message>> BotInteraction::reply_async(
     ReplyParameters reply;
     reply.MessageId = _m.Id;
     parms.Reply = reply;
+    if (markup) {
+        parms.ReplyMarkup = *markup;
+    }
 
     return _bot.send_message_async(parms);
 }
 
+SessionKey BotInteraction::get_session_key() const {
+    return SessionKey{ session_chat_id(_m.Chat.Id), _m.From.Id };
+}
+
+SessionStore& BotInteraction::get_sessions() const {
+    return _bot.get_session_store();
+}
+
+Future<Result<bool>> CallbackQueryInteraction::answer_async(std::string_view text, bool showAlert) const {
+    if (_answered->exchange(true)) {
+        return {};
+    }
+
+    AnswerCallbackQueryParams parms;
+    parms.CallbackQueryId = _query.Id;
+    parms.Text = text;
+    parms.ShowAlert = showAlert;
+
+    return _bot.answer_callback_query_async(parms);
+}
+
+SessionKey CallbackQueryInteraction::get_session_key() const {
+    // buttons of inline messages have no chat, their sessions are per user only
+    const long chat = _query.Message ? session_chat_id(_query.Message->Chat.Id) : 0;
+    return SessionKey{ chat, _query.From.Id };
+}
+
+Future<Result<bool>> InlineQueryInteraction::answer_async(std::vector<InlineQueryResult> results,
+                                                          std::string nextOffset, int cacheTime) const {
+    AnswerInlineQueryParams parms;
+    parms.InlineQueryId = _query.Id;
+    parms.Results = std::move(results);
+    parms.NextOffset = std::move(nextOffset);
+    parms.CacheTime = cacheTime;
+
+    return _bot.answer_inline_query_async(parms);
+}
+
+Future<Result<bool>> PreCheckoutQueryInteraction::answer_async(bool ok, std::string_view errorMessage) const {
+    if (_answered->exchange(true)) {
+        return {};
+    }
+
+    AnswerPreCheckoutQueryParams parms;
+    parms.PreCheckoutQueryId = _query.Id;
+    parms.Ok = ok;
+    parms.ErrorMessage = errorMessage;
+
+    return _bot.answer_pre_checkout_query_async(parms);
+}
+
 mylog::Logger& BotInteractionModuleBase::get_logger() const {
     return *_logger;
 }
 
-void BotInteractionModuleBase::receive_message(tg::UniquePtr<BotInteraction> interaction) {
-    _current = std::move(interaction);
-    on_receive_message();
-    _current.reset();
+std::size_t BotInteractionModuleBase::get_pending_count() const {
+    std::lock_guard lock{ _pending->Mutex };
+    return _pending->Commands.size();
+}
+
+void BotInteractionModuleBase::track_pending(const BotInteraction& interaction, std::string_view command,
+                                             function::PendingResult result) {
+    std::lock_guard lock{ _pending->Mutex };
+    _pending->Commands.push_back(PendingCommand{ std::string(command), std::move(result) });
+    if (_pending->IsPolling) {
+        return;
+    }
+
+    _pending->IsPolling = true;
+    interaction.get_bot().get_timer_service().add_timer([pending = _pending](TimerReply& reply) {
+        poll_pending(*pending, reply);
+    }, PENDING_POLL_INTERVAL, /*looping*/ true, PENDING_POLL_INTERVAL);
+}
+
+void BotInteractionModuleBase::poll_pending(PendingCommands& pending, TimerReply& reply) {
+    std::lock_guard lock{ pending.Mutex };
+
+    auto& commands = pending.Commands;
+    for (std::size_t i = 0; i < commands.size();) {
+        bool done = true;
+        try {
+            done = commands[i].Result.poll();
+            if (done) {
+                pending.Logger->info(R"(Interaction "{}" completed)", commands[i].Name);
+            }
+        } catch (const std::exception& e) {
+            pending.Logger->error("Exception occurred while interaction execution: {}", e.what());
+        }
+
+        if (done) {
+            commands[i] = std::move(commands.back());
+            commands.pop_back();
+        } else {
+            ++i;
+        }
+    }
+
+    if (commands.empty()) {
+        pending.IsPolling = false;
+        reply.set_delete();
+    }
+}
+
+std::unique_lock<std::mutex> BotInteractionModuleBase::lock_execution() {
+    if (is_thread_safe()) {
+        return {};
+    }
+    return std::unique_lock{ _executionMutex };
+}
+
+void BotInteractionModuleBase::receive_inline_query(const InlineQueryInteraction& interaction) {
+    if (!_inlineQueryHandler) {
+        return;
+    }
+    try {
+        const InlineQuery& query = interaction.get_query();
+        const std::string text = normalize_inline_query(query.Query);
+
+        auto results = _inlineCache->find(text);
+        if (!results) {
+            auto lock = lock_execution();
+            // the same query may have been handled while waiting for the lock
+            results = _inlineCache->find(text);
+            if (!results) {
+                results = make_shared<const std::vector<InlineQueryResult>>(_inlineQueryHandler(text));
+                _inlineCache->insert(text, results);
+            }
+        }
+
+        // offset is the index of the first result of the page
+        std::size_t offset = 0;
+        const auto [ptr, ec] = std::from_chars(query.Offset.data(), query.Offset.data() + query.Offset.size(), offset);
+        if (ec != std::errc{} || offset > results->size()) {
+            offset = 0;
+        }
+
+        const std::size_t pageSize = std::clamp<std::size_t>(_inlineOptions.PageSize, 1, 50);
+        const std::size_t end = std::min(offset + pageSize, results->size());
+        std::vector<InlineQueryResult> page(results->begin() + offset, results->begin() + end);
+
+        interaction.answer_async(std::move(page), end < results->size() ? std::to_string(end) : "", _inlineOptions.ClientCacheTime);
+    } catch (const std::exception& e) {
+        get_logger().error("Exception occurred while handling inline query: {}", e.what());
+    }
+}
+
+void BotInteractionModuleBase::run_middleware(const MiddlewareContext& context, MiddlewareStage stage) {
+    if (_middlewareRunner == nullptr) {
+        stage(*this, context);
+        return;
+    }
+    _middlewareRunner(_middleware.get(), context, *this, stage);
 }
 
-void BotInteractionModuleBase::execute_interaction(UniquePtr<BotInteraction> interaction) {
-    _current = std::move(interaction);
+void BotInteractionModuleBase::receive_message(const BotInteraction& interaction) {
     try {
-        std::string command;
-        std::string argsList;
-        function::ArgumentList args;
-        if (parse_command_from_text(_current->get_message(), _current->get_bot(), /*out*/ command, /*out*/ argsList)) {
-            get_logger().info(R"(Received interaction "{}")", command);
-
-            auto it = _mapping.find(command);
-            if (it != _mapping.end()) {
-
-                if (parse_command_arguments(*it->second, argsList, /*out*/ args)) {
-                    (*it->second)(args);
-                    get_logger().info(R"(Interaction "{}" OK [Args = "{}"  Num = {}])", command, argsList, args.size());
-
-                } else {
-                    get_logger().error(R"(Interaction "{}" failed: not enough arguments)", command);
-                }
+        run_middleware(MiddlewareContext{ interaction, nullptr }, [](BotInteractionModuleBase& self, const MiddlewareContext& context) {
+            auto lock = self.lock_execution();
+            self.dispatch_triggers(context.Interaction);
+            self.on_receive_message(context.Interaction);
+        });
+    } catch (const std::exception& e) {
+        get_logger().error("Exception occurred while handling message: {}", e.what());
+    }
+}
+
+void BotInteractionModuleBase::dispatch_triggers(const BotInteraction& interaction) {
+    if (_triggerHandlers.empty()) {
+        return;
+    }
+
+    // triggers are added during construction, automaton is built by the first message
+    if (!_triggersCompiled.load(std::memory_order_acquire)) {
+        std::lock_guard lock{ _triggersMutex };
+        if (!_triggers.is_compiled()) {
+            _triggers.compile();
+        }
+        _triggersCompiled.store(true, std::memory_order_release);
+    }
+
+    const std::string_view text = interaction.get_message().Text;
+    std::vector<TriggerMatcher::Match> matches;
+    _triggers.find_all(text, matches);
+    if (matches.empty()) {
+        return;
+    }
+
+    std::vector<bool> called(_triggerHandlers.size(), false);
+    for (const auto& match : matches) {
+        if (called[match.Id]) {
+            continue;
+        }
+        called[match.Id] = true;
+
+        try {
+            _triggerHandlers[match.Id](interaction, text.substr(match.Position, match.Length));
+        } catch (const std::exception& e) {
+            get_logger().error("Exception occurred while handling trigger: {}", e.what());
+        }
+    }
+}
+
+void BotInteractionModuleBase::add_callback_route(std::uint16_t id, std::string_view name,
+                                                  std::function<bool(const CallbackQueryInteraction&)> handler) {
+    if (_callbackRouteIndex.empty()) {
+        _callbackRouteIndex.assign(detail::CALLBACK_ROUTES, 0);
+    }
+
+    auto& slot = _callbackRouteIndex[id];
+    if (slot != 0) {
+        throw std::logic_error(fmt::format(R"(callback route "{}" collides with "{}", rename one of them)",
+                                           name, _callbackRoutes[slot - 1].Name));
+    }
+    _callbackRoutes.push_back(CallbackRouteEntry{ std::string(name), std::move(handler) });
+    slot = static_cast<std::uint16_t>(_callbackRoutes.size());
+}
+
+const BotInteractionModuleBase::CallbackRouteEntry* BotInteractionModuleBase::find_callback_route(std::string_view data) const {
+    const auto id = detail::read_callback_route(data);
+    if (id >= _callbackRouteIndex.size() || _callbackRouteIndex[id] == 0) {
+        return nullptr;
+    }
+    return &_callbackRoutes[_callbackRouteIndex[id] - 1];
+}
+
+void BotInteractionModuleBase::receive_callback_query(const CallbackQueryInteraction& interaction) {
+    const auto* route = find_callback_route(interaction.get_query().Data);
+    if (!route && !_callbackQueryHandler) {
+        return;
+    }
+    auto lock = lock_execution();
+    try {
+        if (route) {
+            if (route->Handler(interaction)) {
+                return;
             }
+            get_logger().warn(R"(Callback data "{}" does not match arguments of route "{}")", interaction.get_query().Data, route->Name);
+        }
+        if (_callbackQueryHandler) {
+            _callbackQueryHandler(interaction);
+        }
+    } catch (const std::exception& e) {
+        get_logger().error("Exception occurred while handling callback query: {}", e.what());
+    }
+}
+
+void BotInteractionModuleBase::receive_pre_checkout_query(const PreCheckoutQueryInteraction& interaction) {
+    if (!_preCheckoutQueryHandler) {
+        return;
+    }
+    auto lock = lock_execution();
+    try {
+        _preCheckoutQueryHandler(interaction);
+    } catch (const std::exception& e) {
+        get_logger().error("Exception occurred while handling pre-checkout query: {}", e.what());
+    }
+}
+
+void BotInteractionModuleBase::execute_interaction(const BotInteraction& interaction) {
+    try {
+        if (auto cmd = parse_command_from_text(interaction.get_message(), interaction.get_bot().get_profile().UserName)) {
+            run_middleware(MiddlewareContext{ interaction, &*cmd }, [](BotInteractionModuleBase& self, const MiddlewareContext& context) {
+                self.dispatch_command(context.Interaction, *context.Command);
+            });
         }
     } catch (const std::exception& e) {
         // ...
         get_logger().error("Exception occurred while interaction execution: {}", e.what());
     }
-    _current.reset();
 }
 
-BotInteractionModuleBase::BotInteractionModuleBase() {
+void BotInteractionModuleBase::dispatch_command(const BotInteraction& interaction, const CommandView& cmd) {
+    auto lock = lock_execution();
+    const auto command = cmd.Name;
+    const auto argsList = cmd.Args;
+    get_logger().info(R"(Received interaction "{}")", command);
+
+    std::optional<function::PendingResult> pending;
+    const auto route = _commandRouter
+        ? _commandRouter(_commandTable, *this, interaction, command, argsList, pending)
+        : RouteResult::NOT_FOUND;
+
+    auto it = route == RouteResult::NOT_FOUND ? _mapping.find(command) : _mapping.end();
+    if (route == RouteResult::INVOKED) {
+        get_logger().info(R"(Interaction "{}" OK [Args = "{}"])", command, argsList);
+
+    } else if (route == RouteResult::INVALID_ARGUMENTS) {
+        get_logger().error(R"(Interaction "{}" failed: arguments do not match)", command);
+
+    } else if (it != _mapping.end()) {
+
+        if (it->second->invoke(interaction, argsList, pending)) {
+            get_logger().info(R"(Interaction "{}" OK [Args = "{}"  Num = {}])", command, argsList, it->second->num_parameters());
+
+        } else {
+            get_logger().error(R"(Interaction "{}" failed: arguments do not match)", command);
+        }
+    }
+
+    if (pending && pending->is_deferred()) {
+        // deferred handler would block timers of the bot, it runs on this worker once the module is unlocked
+        if (lock.owns_lock()) {
+            lock.unlock();
+        }
+        try {
+            pending->poll();
+            get_logger().info(R"(Interaction "{}" completed)", command);
+        } catch (const std::exception& e) {
+            get_logger().error("Exception occurred while interaction execution: {}", e.what());
+        }
+    } else if (pending) {
+        track_pending(interaction, command, std::move(*pending));
+    }
+}
+
+BotInteractionModuleBase::BotInteractionModuleBase()
+    : _pending{ make_shared<PendingCommands>() }
+{
     _logger = mylog::LogManager::get().create_logger("Interaction");
+    _pending->Logger = _logger;
 }
 
 }
\ No newline at end of file
@@ -0,0 +1,187 @@
+#include "tgapi/bot/cron_schedule.h"
+
+#include <charconv>
+#include <stdexcept>
+#include <vector>
+
+#include <boost/date_time/local_time/local_time.hpp>
+#include <fmt/format.h>
+
+namespace tg
+{
+
+namespace {
+
+namespace gregorian = boost::gregorian;
+namespace posix_time = boost::posix_time;
+namespace local_time = boost::local_time;
+
+// matching day is always found within a leap cycle, unless the schedule names impossible date (e.g. February 30)
+constexpr int MAX_SEARCH_DAYS = 366 * 8;
+
+struct FieldRange {
+    std::string_view Name;
+    unsigned Min;
+    unsigned Max;
+};
+
+std::vector<std::string_view> split(std::string_view s, char separator) {
+    std::vector<std::string_view> parts;
+    std::size_t pos = 0;
+    while (true) {
+        const auto next = s.find(separator, pos);
+        parts.push_back(s.substr(pos, next == std::string_view::npos ? std::string_view::npos : next - pos));
+        if (next == std::string_view::npos) {
+            return parts;
+        }
+        pos = next + 1;
+    }
+}
+
+unsigned parse_number(std::string_view s, const FieldRange& range) {
+    unsigned value = 0;
+    const auto [ptr, ec] = std::from_chars(s.data(), s.data() + s.size(), value);
+    if (ec != std::errc{} || ptr != s.data() + s.size()) {
+        throw std::runtime_error(fmt::format(R"(invalid {} "{}")", range.Name, s));
+    }
+    if (value < range.Min || value > range.Max) {
+        throw std::runtime_error(fmt::format("{} {} is out of range {}-{}", range.Name, value, range.Min, range.Max));
+    }
+    return value;
+}
+
+/**
+ * Parse field into bit set of matching values
+ * @param [out] any True if field is *
+ */
+std::uint64_t parse_field(std::string_view field, const FieldRange& range, bool& any) {
+    any = field == "*";
+
+    std::uint64_t bits = 0;
+    for (auto item : split(field, ',')) {
+        unsigned step = 1;
+        if (const auto slash = item.find('/'); slash != std::string_view::npos) {
+            step = parse_number(item.substr(slash + 1), FieldRange{ range.Name, 1, range.Max });
+            item = item.substr(0, slash);
+        }
+
+        unsigned from = range.Min;
+        unsigned to = range.Max;
+        if (item != "*") {
+            const auto dash = item.find('-');
+            from = parse_number(item.substr(0, dash), range);
+            to = dash == std::string_view::npos ? from : parse_number(item.substr(dash + 1), range);
+            if (to < from) {
+                throw std::runtime_error(fmt::format(R"(invalid {} range "{}")", range.Name, item));
+            }
+        }
+
+        for (unsigned v = from; v <= to; v += step) {
+            bits |= std::uint64_t{ 1 } << v;
+        }
+    }
+    return bits;
+}
+
+bool has(std::uint64_t bits, unsigned value) {
+    return (bits >> value) & 1;
+}
+
+}
+
+struct CronSchedule::Zone {
+    local_time::time_zone_ptr Tz;
+};
+
+CronSchedule::CronSchedule(std::string_view expression, std::string_view timezone) {
+    std::vector<std::string_view> fields;
+    for (auto field : split(expression, ' ')) {
+        if (!field.empty()) {
+            fields.push_back(field);
+        }
+    }
+    if (fields.size() != 5) {
+        throw std::runtime_error(fmt::format(R"(cron expression "{}" must have 5 fields)", expression));
+    }
+
+    bool any;
+    _minutes = parse_field(fields[0], FieldRange{ "minute", 0, 59 }, any);
+    _hours = static_cast<std::uint32_t>(parse_field(fields[1], FieldRange{ "hour", 0, 23 }, any));
+    _days = static_cast<std::uint32_t>(parse_field(fields[2], FieldRange{ "day of month", 1, 31 }, _anyDay));
+    _months = static_cast<std::uint32_t>(parse_field(fields[3], FieldRange{ "month", 1, 12 }, any));
+    _weekdays = static_cast<std::uint32_t>(parse_field(fields[4], FieldRange{ "day of week", 0, 7 }, _anyWeekday));
+
+    // 7 is Sunday too
+    if (has(_weekdays, 7)) {
+        _weekdays = (_weekdays | 1) & ~(std::uint32_t{ 1 } << 7);
+    }
+
+    if (!timezone.empty()) {
+        try {
+            _zone = make_shared<const Zone>(Zone{ local_time::time_zone_ptr(new local_time::posix_time_zone(std::string(timezone))) });
+        } catch (const std::exception& e) {
+            throw std::runtime_error(fmt::format(R"(invalid timezone "{}": {})", timezone, e.what()));
+        }
+    }
+
+    _key = fmt::format("{:x} {:x} {:x}{} {:x} {:x}{} {}", _minutes, _hours, _days, _anyDay ? "*" : "",
+                       _months, _weekdays, _anyWeekday ? "*" : "", timezone);
+}
+
+bool CronSchedule::is_day(unsigned day, unsigned weekday) const {
+    const bool dayMatch = has(_days, day);
+    const bool weekdayMatch = has(_weekdays, weekday);
+
+    if (_anyDay || _anyWeekday) {
+        return dayMatch && weekdayMatch;
+    }
+    return dayMatch || weekdayMatch;
+}
+
+std::optional<long> CronSchedule::next_after(long unixMs) const {
+    const posix_time::ptime epoch{ gregorian::date(1970, 1, 1) };
+    const posix_time::ptime utc = epoch + posix_time::milliseconds(unixMs);
+    const posix_time::ptime local = _zone ? local_time::local_date_time(utc, _zone->Tz).local_time() : utc;
+
+    gregorian::date day = local.date();
+    // search from the minute which follows the time
+    long firstMinute = local.time_of_day().hours() * 60 + local.time_of_day().minutes() + 1;
+
+    for (int i = 0; i < MAX_SEARCH_DAYS; ++i, day += gregorian::days(1), firstMinute = 0) {
+        if (!has(_months, day.month()) || !is_day(day.day(), day.day_of_week())) {
+            continue;
+        }
+
+        for (long minuteOfDay = firstMinute; minuteOfDay < 24 * 60; ++minuteOfDay) {
+            const auto hour = static_cast<unsigned>(minuteOfDay / 60);
+            if (!has(_hours, hour)) {
+                // skip to the next hour
+                minuteOfDay = (hour + 1) * 60 - 1;
+                continue;
+            }
+            if (!has(_minutes, static_cast<unsigned>(minuteOfDay % 60))) {
+                continue;
+            }
+
+            const posix_time::time_duration time = posix_time::minutes(minuteOfDay);
+            posix_time::ptime candidate{ day, time };
+            if (_zone) {
+                const auto dst = local_time::local_date_time::check_dst(day, time, _zone->Tz);
+                if (dst == boost::date_time::invalid_time_label) {
+                    continue;
+                }
+                // repeated time fires at its first occurrence, which is still in daylight saving time
+                const bool inDst = dst != boost::date_time::is_not_in_dst;
+                candidate = local_time::local_date_time(day, time, _zone->Tz, inDst).utc_time();
+            }
+
+            const long result = static_cast<long>((candidate - epoch).total_milliseconds());
+            if (result > unixMs) {
+                return result;
+            }
+        }
+    }
+    return std::nullopt;
+}
+
+}
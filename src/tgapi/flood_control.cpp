@@ -0,0 +1,292 @@
+#include "tgapi/command/flood_control.h"
+
+#include "tgapi/command/command_module.h"
+#include "configuration/configuration.h"
+#include "log/logging.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <charconv>
+#include <mutex>
+#include <shared_mutex>
+#include <stdexcept>
+#include <unordered_map>
+#include <vector>
+
+#include <fmt/format.h>
+
+namespace tg {
+
+namespace {
+
+constexpr std::size_t SHARD_COUNT = 16;
+constexpr std::size_t SWEEP_STEPS = 2;      // keys checked for idleness per new key
+
+template<typename T>
+T read_config_number(const config::Store& config, std::string_view key, T defaultValue) {
+    const std::string_view value = config[key];
+    if (value.empty()) {
+        return defaultValue;
+    }
+
+    T result{};
+    const auto [ptr, ec] = std::from_chars(value.data(), value.data() + value.size(), result);
+    if (ec != std::errc{} || ptr != value.data() + value.size()) {
+        throw std::runtime_error(fmt::format(R"(invalid value of "{}": "{}")", key, value));
+    }
+    return result;
+}
+
+FloodLimit read_config_limit(const config::Store& config, std::string_view section, FloodLimit limit) {
+    limit.Interval = std::chrono::milliseconds(read_config_number(
+        config, fmt::format("Telegram::FloodControl::{}::Interval", section), limit.Interval.count()));
+    limit.Burst = read_config_number(config, fmt::format("Telegram::FloodControl::{}::Burst", section), limit.Burst);
+    return limit;
+}
+
+}
+
+FloodControlConfig FloodControlConfig::from_config(const config::Store& config) {
+    FloodControlConfig result;
+    result.User = read_config_limit(config, "User", result.User);
+    result.Chat = read_config_limit(config, "Chat", result.Chat);
+    result.IdleTimeout = std::chrono::milliseconds(
+        read_config_number(config, "Telegram::FloodControl::IdleTimeout", result.IdleTimeout.count()));
+    result.MaxKeys = read_config_number(config, "Telegram::FloodControl::MaxKeys", result.MaxKeys);
+
+    if (const auto commandsOnly = config["Telegram::FloodControl::CommandsOnly"]; !commandsOnly.empty()) {
+        result.CommandsOnly = commandsOnly == "true";
+    }
+    if (const auto notice = config["Telegram::FloodControl::CooldownNotice"]; !notice.empty()) {
+        result.CooldownNotice = notice;
+    }
+    return result;
+}
+
+#pragma region FloodLimiter
+
+struct FloodLimiter::Impl {
+
+    // Token bucket as theoretical arrival time (GCRA): request is allowed if the bucket time after taking
+    // the token is no further ahead of now than Burst intervals. Single value is updated with one CAS
+    struct Entry {
+        std::atomic<std::int64_t> Tat { 0 };   // ns of Clock
+        std::atomic<bool> Noticed { false };
+        std::atomic<bool> Referenced { false }; // taken since the clock hand passed the key
+    };
+
+    // Keys also form a ring walked by a clock hand, which erases idle keys a few at a time and evicts
+    // the first key not taken since the previous pass (CLOCK), so a hit never needs the exclusive lock
+    struct Shard {
+        mutable std::shared_mutex Mutex;
+        std::unordered_map<long, Entry> Entries;
+        std::vector<long> Ring;
+        std::size_t Hand { 0 };
+    };
+
+    Impl(FloodLimit limit, std::chrono::milliseconds idleTimeout, std::size_t maxKeys)
+        : Interval{ std::chrono::nanoseconds(limit.Interval).count() }
+        , Tolerance{ Interval * std::max(limit.Burst, 1u) }
+        , IdleTimeout{ std::chrono::nanoseconds(idleTimeout).count() }
+        , MaxKeysPerShard{ std::max<std::size_t>(maxKeys / SHARD_COUNT, 1) }
+    {}
+
+    Shard& shard_of(long key) {
+        // IDs are sequential, mix them before taking the top bits
+        const auto hash = static_cast<std::uint64_t>(key) * 0x9E3779B97F4A7C15ull;
+        return Shards[hash >> 60];
+    }
+
+    bool is_available(const Entry& entry, std::int64_t now) const {
+        return std::max(entry.Tat.load(std::memory_order_relaxed), now) + Interval - now <= Tolerance;
+    }
+
+    Decision take(Entry& entry, std::int64_t now) const {
+        if (!entry.Referenced.load(std::memory_order_relaxed)) {
+            entry.Referenced.store(true, std::memory_order_relaxed);
+        }
+
+        std::int64_t tat = entry.Tat.load(std::memory_order_relaxed);
+        while (true) {
+            const std::int64_t next = std::max(tat, now) + Interval;
+            if (next - now > Tolerance) {
+                return entry.Noticed.exchange(true, std::memory_order_relaxed) ? Decision::THROTTLE : Decision::THROTTLE_FIRST;
+            }
+            if (entry.Tat.compare_exchange_weak(tat, next, std::memory_order_relaxed)) {
+                if (entry.Noticed.load(std::memory_order_relaxed)) {
+                    entry.Noticed.store(false, std::memory_order_relaxed);
+                }
+                return Decision::ALLOW;
+            }
+        }
+    }
+
+    /**
+     * Erase the key under the clock hand, shard must be locked exclusively
+     */
+    void erase_at_hand(Shard& shard, std::unordered_map<long, Entry>::iterator it) const {
+        shard.Entries.erase(it);
+        shard.Ring[shard.Hand] = shard.Ring.back();
+        shard.Ring.pop_back();
+        if (shard.Hand >= shard.Ring.size()) {
+            shard.Hand = 0;
+        }
+    }
+
+    void advance_hand(Shard& shard) const {
+        shard.Hand = (shard.Hand + 1) % shard.Ring.size();
+    }
+
+    /**
+     * Erase keys with full bucket which were not seen for idle timeout among the next few keys of the ring,
+     * shard must be locked exclusively
+     */
+    void sweep(Shard& shard, std::int64_t now) const {
+        for (std::size_t i = 0; i < SWEEP_STEPS && !shard.Ring.empty(); ++i) {
+            auto it = shard.Entries.find(shard.Ring[shard.Hand]);
+            if (now - it->second.Tat.load(std::memory_order_relaxed) > IdleTimeout) {
+                erase_at_hand(shard, it);
+            } else {
+                advance_hand(shard);
+            }
+        }
+    }
+
+    /**
+     * Erase the first key which was not taken since the hand passed it, shard must be locked exclusively.
+     * Every step clears a mark set by a hit, so eviction is amortized constant
+     */
+    void evict(Shard& shard) const {
+        while (true) {
+            auto it = shard.Entries.find(shard.Ring[shard.Hand]);
+            if (!it->second.Referenced.exchange(false, std::memory_order_relaxed)) {
+                erase_at_hand(shard, it);
+                return;
+            }
+            advance_hand(shard);
+        }
+    }
+
+    const std::int64_t Interval;
+    const std::int64_t Tolerance;
+    const std::int64_t IdleTimeout;
+    const std::size_t MaxKeysPerShard;
+    std::array<Shard, SHARD_COUNT> Shards;
+};
+
+FloodLimiter::FloodLimiter(FloodLimit limit, std::chrono::milliseconds idleTimeout, std::size_t maxKeys)
+    : _impl{ make_unique<Impl>(limit, idleTimeout, maxKeys) }
+{}
+
+FloodLimiter::~FloodLimiter() = default;
+
+FloodLimiter::Decision FloodLimiter::acquire(long key, Clock::time_point now) {
+    const std::int64_t nowNs = std::chrono::duration_cast<std::chrono::nanoseconds>(now.time_since_epoch()).count();
+    auto& shard = _impl->shard_of(key);
+
+    {
+        std::shared_lock lock{ shard.Mutex };
+        if (auto it = shard.Entries.find(key); it != shard.Entries.end()) {
+            return _impl->take(it->second, nowNs);
+        }
+    }
+
+    std::unique_lock lock{ shard.Mutex };
+    auto it = shard.Entries.find(key);
+    if (it == shard.Entries.end()) {
+        _impl->sweep(shard, nowNs);
+        if (shard.Entries.size() >= _impl->MaxKeysPerShard) {
+            // memory is bounded, forget a key which was not used recently
+            _impl->evict(shard);
+        }
+        it = shard.Entries.try_emplace(key).first;
+        shard.Ring.push_back(key);
+    }
+    return _impl->take(it->second, nowNs);
+}
+
+bool FloodLimiter::is_available(long key, Clock::time_point now) const {
+    const std::int64_t nowNs = std::chrono::duration_cast<std::chrono::nanoseconds>(now.time_since_epoch()).count();
+    auto& shard = _impl->shard_of(key);
+
+    std::shared_lock lock{ shard.Mutex };
+    auto it = shard.Entries.find(key);
+    return it == shard.Entries.end() || _impl->is_available(it->second, nowNs);
+}
+
+std::size_t FloodLimiter::size() const {
+    std::size_t size = 0;
+    for (const auto& shard : _impl->Shards) {
+        std::shared_lock lock{ shard.Mutex };
+        size += shard.Entries.size();
+    }
+    return size;
+}
+
+#pragma endregion // FloodLimiter
+
+#pragma region FloodControl
+
+struct FloodControl::State {
+
+    explicit State(FloodControlConfig config)
+        : Config{ std::move(config) }
+        , Users{ Config.User, Config.IdleTimeout, Config.MaxKeys }
+        , Chats{ Config.Chat, Config.IdleTimeout, Config.MaxKeys }
+        , Logger{ mylog::LogManager::get().create_logger("FloodControl") }
+    {}
+
+    const FloodControlConfig Config;
+    FloodLimiter Users;
+    FloodLimiter Chats;
+    std::atomic<std::uint64_t> Throttled { 0 };
+    mylog::LoggerPtr Logger;
+};
+
+FloodControl::FloodControl(FloodControlConfig config)
+    : _state{ make_shared<State>(std::move(config)) }
+{}
+
+bool FloodControl::operator()(const MiddlewareContext& context) {
+    if (_state->Config.CommandsOnly && context.Command == nullptr) {
+        return true;
+    }
+
+    const Message& m = context.Interaction.get_message();
+    const long* chatId = std::get_if<long>(&m.Chat.Id);
+    const auto now = FloodLimiter::Clock::now();
+
+    // both buckets are checked before taking any token, so a message throttled by its chat costs the user nothing
+    FloodLimiter::Decision decision;
+    if (!_state->Users.is_available(m.From.Id, now)) {
+        decision = _state->Users.acquire(m.From.Id, now);
+    } else if (chatId != nullptr && !_state->Chats.is_available(*chatId, now)) {
+        decision = _state->Chats.acquire(*chatId, now);
+    } else {
+        decision = _state->Users.acquire(m.From.Id, now);
+        if (decision == FloodLimiter::Decision::ALLOW && chatId != nullptr) {
+            decision = _state->Chats.acquire(*chatId, now);
+        }
+    }
+    if (decision == FloodLimiter::Decision::ALLOW) {
+        return true;
+    }
+
+    ++_state->Throttled;
+    if (decision == FloodLimiter::Decision::THROTTLE_FIRST) {
+        _state->Logger->warn("Throttling messages of user {}", m.From.Id);
+        if (!_state->Config.CooldownNotice.empty()) {
+            context.Interaction.reply_async(_state->Config.CooldownNotice);
+        }
+    }
+    return false;
+}
+
+std::uint64_t FloodControl::get_throttled_count() const {
+    return _state->Throttled;
+}
+
+#pragma endregion // FloodControl
+
+}
@@ -0,0 +1,74 @@
+#include "tgapi/command/inline_query.h"
+
+#include <algorithm>
+#include <cctype>
+
+namespace tg {
+
+std::string normalize_inline_query(std::string_view query) {
+    std::string result;
+    result.reserve(query.size());
+
+    bool space = false;
+    for (char ch : query) {
+        const auto byte = static_cast<unsigned char>(ch);
+        if (std::isspace(byte)) {
+            space = !result.empty();
+            continue;
+        }
+        if (space) {
+            result.push_back(' ');
+            space = false;
+        }
+        result.push_back(static_cast<char>(std::tolower(byte)));
+    }
+    return result;
+}
+
+InlineResultCache::InlineResultCache(std::size_t capacity, std::chrono::milliseconds ttl)
+    : _capacity{ std::max<std::size_t>(capacity, 1) }
+    , _ttl{ ttl }
+{}
+
+InlineResultCache::Results InlineResultCache::find(std::string_view key, Clock::time_point now) {
+    std::lock_guard lock{ _mutex };
+    auto it = _index.find(key);
+    if (it == _index.end()) {
+        return nullptr;
+    }
+
+    auto entry = it->second;
+    if (entry->Expires <= now) {
+        _index.erase(it);
+        _entries.erase(entry);
+        return nullptr;
+    }
+
+    _entries.splice(_entries.begin(), _entries, entry);
+    return entry->Value;
+}
+
+void InlineResultCache::insert(std::string_view key, Results results, Clock::time_point now) {
+    std::lock_guard lock{ _mutex };
+    if (auto it = _index.find(key); it != _index.end()) {
+        it->second->Value = std::move(results);
+        it->second->Expires = now + _ttl;
+        _entries.splice(_entries.begin(), _entries, it->second);
+        return;
+    }
+
+    if (_entries.size() >= _capacity) {
+        _index.erase(_entries.back().Key);
+        _entries.pop_back();
+    }
+
+    _entries.push_front(Entry{ std::string(key), std::move(results), now + _ttl });
+    _index.emplace(_entries.front().Key, _entries.begin());
+}
+
+std::size_t InlineResultCache::size() const {
+    std::lock_guard lock{ _mutex };
+    return _entries.size();
+}
+
+}
@@ -7,7 +7,12 @@
 
 #include <boost/beast/http.hpp>
 #include <boost/beast/version.hpp>
+#include <chrono>
+#include <list>
+#include <mutex>
+#include <unordered_map>
 #include <utility>
+#include <vector>
 
 #include <rapidjson/stringbuffer.h>
 #include <rapidjson/writer.h>
@@ -44,10 +49,11 @@ void Request::set_json_content(const JValue& content) {
     _stringJsonContent = buf.GetString();
 }
 
-Response::Response(std::string_view content) {
+Response::Response(std::string content) {
+    _content = std::make_shared<const std::string>(std::move(content));
     _doc = std::make_shared<rapidjson::Document>();
 
-    rapidjson::StringStream ss{ content.data() };
+    rapidjson::StringStream ss{ _content->c_str() };
     _doc->ParseStream(ss);
 }
 
@@ -55,6 +61,10 @@ const JDoc* Response::get_json() const {
     return _doc.get();
 }
 
+std::string_view Response::get_content() const {
+    return *_content;
+}
+
 #pragma region Client Implementation
 
 namespace {
@@ -73,24 +83,90 @@ auto generate_id() {
 }
 
 
+// idle connections are kept per host, the gateway closes keep-alive connections after about a minute
+constexpr std::size_t MAX_IDLE_CONNECTIONS = 16;
+constexpr std::chrono::seconds IDLE_TIMEOUT{ 30 };
+
+struct Connection {
+    Connection(asio::any_io_executor executor, ssl::context& sslContext)
+        : Stream{ std::move(executor), sslContext }
+    {}
+
+    beast::ssl_stream<beast::tcp_stream> Stream;
+    beast::flat_buffer Buffer;
+    std::chrono::steady_clock::time_point IdleSince;
+};
+
+/**
+ * Keep-alive connections shared by requests to the same host, so that resolve, connect and TLS handshake
+ * are done once per connection instead of once per request
+ */
+class ConnectionPool {
+public:
+
+    UniquePtr<Connection> acquire(const std::string& host) {
+        const auto now = std::chrono::steady_clock::now();
+
+        std::unique_lock lock{ _mutex };
+        auto& idle = _idle[host];
+        while (!idle.empty()) {
+            auto connection = std::move(idle.back());
+            idle.pop_back();
+            if (now - connection->IdleSince < IDLE_TIMEOUT) {
+                return connection;
+            }
+        }
+        return nullptr;
+    }
+
+    void release(const std::string& host, UniquePtr<Connection> connection) {
+        connection->IdleSince = std::chrono::steady_clock::now();
+
+        std::unique_lock lock{ _mutex };
+        auto& idle = _idle[host];
+        if (idle.size() < MAX_IDLE_CONNECTIONS) {
+            idle.push_back(std::move(connection));
+        }
+    }
+
+    void clear() {
+        std::unique_lock lock{ _mutex };
+        _idle.clear();
+    }
+
+private:
+    std::mutex _mutex;
+    std::unordered_map<std::string, std::vector<UniquePtr<Connection>>> _idle;
+};
+
 // @todo Handle destruction of the RestClient
 
 class RequestHandler {
 
+    void connect_async();
     void on_resolve(const system::error_code& ec, const tcp::resolver::results_type& r);
     void on_connect(const system::error_code& ec, const tcp::endpoint& ep);
     void on_handshake(const system::error_code& ec);
-    void on_sent(const system::error_code& ec, size_t bytesSent);
+    void send_request();
+    void on_sent(const system::error_code& ec);
+    void on_received(const system::error_code& ec, std::size_t received);
+    void on_failed(std::size_t received);
+
+    void open_connection();
+    http::request<http::string_body> make_request() const;
+    system::error_code exchange(http::response<http::string_body>& res, bool& retry);
+    void release_connection(const http::response<http::string_body>& res);
 
 public:
 
     using Callback = std::function<void(long, Response)>;
 
-    RequestHandler(Request request, http::verb verb, asio::any_io_executor executor);
+    RequestHandler(Request request, http::verb verb, asio::any_io_executor executor, ssl::context& sslContext,
+                   ConnectionPool& pool);
     RequestHandler(const RequestHandler&) = delete;
     RequestHandler(RequestHandler&&) = default;
     RequestHandler& operator=(const RequestHandler&) = delete;
-    RequestHandler& operator=(RequestHandler&&) = default;
+    RequestHandler& operator=(RequestHandler&&) = delete;
 
     void send_async(Callback cb);
     Response send();
@@ -105,54 +181,112 @@ public:
 
 private:
     Request _request;
+    std::string _host;
     http::verb _verb;
     long _id;
     UniquePtr<Callback> _cb;
     asio::any_io_executor _executor;
     asio::ip::tcp::resolver _resolver;
-    asio::ssl::context _sslContext;
-    beast::ssl_stream<boost::beast::tcp_stream> _stream;
-    beast::flat_buffer _buffer;
+    ssl::context& _sslContext;
+    ConnectionPool& _pool;
+    UniquePtr<Connection> _connection;
+    bool _reused { false };
+    http::request<http::string_body> _req;
+    http::response<http::string_body> _res;
 };
 
 long RequestHandler::get_id() const {
     return _id;
 }
 
-RequestHandler::RequestHandler(Request request, http::verb verb, asio::any_io_executor executor)
+RequestHandler::RequestHandler(Request request, http::verb verb, asio::any_io_executor executor, ssl::context& sslContext,
+                               ConnectionPool& pool)
     : _request{ std::move(request) }
+    , _host{ _request.get_url().host() }
     , _verb{ verb }
     , _id{ generate_id() }
     , _executor{ std::move(executor) }
     , _resolver{ _executor }
-    , _sslContext{ ssl::context::tlsv12_client }
-    , _stream{ _executor, _sslContext }
-{
-    _sslContext.set_default_verify_paths();
-    _sslContext.set_verify_mode(ssl::verify_peer);
-    _sslContext.set_verify_callback(ssl::host_name_verification(_request.get_url().host()));
+    , _sslContext{ sslContext }
+    , _pool{ pool }
+{}
+
+void RequestHandler::open_connection() {
+    _reused = false;
+    _connection = make_unique<Connection>(_executor, _sslContext);
+
+    // verification mode and trusted roots are shared by the client ssl context,
+    // only host name check is specific to this connection
+    _connection->Stream.set_verify_callback(ssl::host_name_verification(_host));
+    if (!SSL_set_tlsext_host_name(_connection->Stream.native_handle(), _host.c_str())) {
+        throw std::runtime_error("ssl Error");
+    }
 }
 
-void RequestHandler::send_async(Callback cb) {
-    using namespace std::placeholders;
+http::request<http::string_body> RequestHandler::make_request() const {
+    http::request<http::string_body> req{ _verb, _request.get_url().encoded_target(), 11 };
+    req.set(http::field::user_agent, BOOST_BEAST_VERSION_STRING);
+    req.set(http::field::host, _host);
+    req.keep_alive(true);
+    if (!_request.get_content().empty()) {
+        req.set(http::field::content_type, "application/json");
+        req.body() = _request.get_content();
+        req.prepare_payload();
+    }
+    return req;
+}
+
+system::error_code RequestHandler::exchange(http::response<http::string_body>& res, bool& retry) {
+    system::error_code ec;
+    http::write(_connection->Stream, make_request(), ec);
+    std::size_t received = 0;
+    if (!ec) {
+        received = http::read(_connection->Stream, _connection->Buffer, res, ec);
+    }
 
+    // same rule as on_failed: resend only if nothing of the response was received
+    retry = ec && _reused && received == 0;
+    return ec;
+}
+
+void RequestHandler::release_connection(const http::response<http::string_body>& res) {
+    if (res.keep_alive()) {
+        _pool.release(_host, std::move(_connection));
+    } else {
+        _connection.reset();
+    }
+}
+
+void RequestHandler::send_async(Callback cb) {
     _cb = make_unique<Callback>(std::move(cb));
 
+    // even with a pooled connection nothing runs on the caller's thread, the callback may send requests itself
+    asio::post(_executor, [this] {
+        _connection = _pool.acquire(_host);
+        if (_connection) {
+            _reused = true;
+            send_request();
+        } else {
+            connect_async();
+        }
+    });
+}
+
+void RequestHandler::connect_async() {
     auto resolve = [this](const system::error_code& ec, const tcp::resolver::results_type& r) {
         on_resolve(ec, r);
     };
 
-    if (!SSL_set_tlsext_host_name(_stream.native_handle(), _request.get_url().host().c_str())) {
+    try {
+        open_connection();
+    } catch (const std::exception&) {
         std::invoke(*_cb, get_id(), Response{""});
+        return;
     }
-    else {
-        _resolver.async_resolve(_request.get_url().host(), _request.get_url().scheme(), resolve);
-    }
+    _resolver.async_resolve(_host, _request.get_url().scheme(), resolve);
 }
 
 void RequestHandler::on_resolve(const system::error_code& ec, const tcp::resolver::results_type& r) {
-    using namespace std::placeholders;
-
     auto connect = [this](const system::error_code& ec, const tcp::endpoint& r) {
         on_connect(ec, r);
     };
@@ -160,13 +294,11 @@ void RequestHandler::on_resolve(const system::error_code& ec, const tcp::resolve
     if (ec) {
         std::invoke(*_cb, get_id(), Response{""});
     } else {
-        beast::get_lowest_layer(_stream).async_connect(r, connect);
+        beast::get_lowest_layer(_connection->Stream).async_connect(r, connect);
     }
 }
 
 void RequestHandler::on_connect(const system::error_code& ec, const tcp::endpoint& ep) {
-    using namespace std::placeholders;
-
     auto handshake = [this](const system::error_code& ec) {
         on_handshake(ec);
     };
@@ -174,72 +306,88 @@ void RequestHandler::on_connect(const system::error_code& ec, const tcp::endpoin
     if (ec){
         std::invoke(*_cb, get_id(), Response{""});
     } else {
-        _stream.async_handshake(ssl::stream_base::client, handshake);
+        _connection->Stream.async_handshake(ssl::stream_base::client, handshake);
     }
 }
 
 void RequestHandler::on_handshake(const system::error_code& ec) {
-    using namespace std::placeholders;
-
     if (ec) {
         std::invoke(*_cb, get_id(), Response{""});
     } else {
-        http::request<http::string_body> req{ _verb, _request.get_url().encoded_target(), 11 };
-        req.set(http::field::user_agent, BOOST_BEAST_VERSION_STRING);
-        req.set(http::field::host, _request.get_url().host());
-        if (!_request.get_content().empty()) {
-            req.set(http::field::content_type, "application/json");
-            req.body() = _request.get_content();
-            req.prepare_payload();
-        }
+        send_request();
+    }
+}
 
-        system::error_code writeEc;
-        const auto written = http::write(_stream, req, writeEc);
+void RequestHandler::send_request() {
+    auto sent = [this](const system::error_code& ec, std::size_t) {
+        on_sent(ec);
+    };
 
-        on_sent(writeEc, written);
-    }
+    _req = make_request();
+    _res = {};
+    http::async_write(_connection->Stream, _req, sent);
 }
 
-void RequestHandler::on_sent(const system::error_code& ec, const size_t) {
+void RequestHandler::on_sent(const system::error_code& ec) {
+    auto received = [this](const system::error_code& ec, std::size_t received) {
+        on_received(ec, received);
+    };
 
     if (ec) {
-        std::invoke(*_cb, get_id(), Response{""});
+        on_failed(0);
     } else {
-
-        http::response<http::string_body> res;
-        http::read(_stream, _buffer, res);
-
-        Response r{ res.body() };
-        std::invoke(*_cb, get_id(), r);
+        http::async_read(_connection->Stream, _connection->Buffer, _res, received);
     }
 }
 
-Response RequestHandler::send() {
-
-    if (!SSL_set_tlsext_host_name(_stream.native_handle(), _request.get_url().host().c_str()))
-    {
-        throw std::runtime_error("ssl Error");
+void RequestHandler::on_received(const system::error_code& ec, std::size_t received) {
+    if (ec) {
+        on_failed(received);
+        return;
     }
 
-    auto results = _resolver.resolve(_request.get_url().host(), _request.get_url().scheme());
-    beast::get_lowest_layer(_stream).connect(results);
-    _stream.handshake(ssl::stream_base::client);
+    release_connection(_res);
+    Response r{ std::move(_res.body()) };
+    std::invoke(*_cb, get_id(), r);
+}
 
-    http::request<http::string_body> req{ _verb, _request.get_url().encoded_target(), 11 };
-    req.set(http::field::user_agent, BOOST_BEAST_VERSION_STRING);
-    req.set(http::field::host, _request.get_url().host());
-    if (!_request.get_content().empty())
-    {
-        req.set(http::field::content_type, "application/json");
-        req.body() = _request.get_content();
-        req.prepare_payload();
+void RequestHandler::on_failed(std::size_t received) {
+    // pooled connection may have been closed by the server while idle, then the request was not handled
+    // and is sent again; once any response byte was received, resending could repeat the request
+    const bool retry = _reused && received == 0;
+    _connection.reset();
+    if (retry) {
+        connect_async();
+    } else {
+        std::invoke(*_cb, get_id(), Response{""});
     }
-    http::write(_stream, req);
+}
 
-    http::response<http::string_body> res;
-    http::read(_stream, _buffer, res);
+Response RequestHandler::send() {
+    _connection = _pool.acquire(_host);
+    _reused = _connection != nullptr;
+
+    while (true) {
+        if (!_connection) {
+            open_connection();
+            auto results = _resolver.resolve(_host, _request.get_url().scheme());
+            beast::get_lowest_layer(_connection->Stream).connect(results);
+            _connection->Stream.handshake(ssl::stream_base::client);
+        }
 
-    return Response{ res.body() };
+        http::response<http::string_body> res;
+        bool retry = false;
+        if (const auto ec = exchange(res, retry)) {
+            _connection.reset();
+            if (retry) {
+                continue;
+            }
+            throw system::system_error(ec);
+        }
+
+        release_connection(res);
+        return Response{ std::move(res.body()) };
+    }
 }
 
 tg::rest::RequestHandler::~RequestHandler() = default;
@@ -250,7 +398,7 @@ class Client::Impl {
     void received_response(long id, Response response, Client::Callback callback);
 public:
 
-    Impl();
+    explicit Impl(std::size_t numThreads);
 
     Impl(const Impl&) = delete;
     Impl(Impl&&) = delete;
@@ -266,24 +414,35 @@ public:
     Response get(const Request& request);
     Response post(const Request& request);
 
+    void shutdown();
+
 private:
     UniquePtr<asio::thread_pool> _tp;
+    ssl::context _sslContext;
+    ConnectionPool _pool;   // connections must be closed before the thread pool is destroyed
     mylog::LoggerPtr _logger;
     std::mutex _mutex;
-    std::vector<RequestHandler> _requests;
+    std::list<RequestHandler> _requests; // handlers must not move while their requests are in flight
 };
 
-Client::Impl::Impl() {
+Client::Impl::Impl(std::size_t numThreads)
+    : _sslContext{ ssl::context::tlsv12_client }
+{
     _logger = mylog::LogManager::get().create_logger("Rest");
-    _tp = make_unique<asio::thread_pool>(4);
+    _tp = make_unique<asio::thread_pool>(std::max<std::size_t>(numThreads, 1));
+
+    _sslContext.set_default_verify_paths();
+    _sslContext.set_verify_mode(ssl::verify_peer);
 }
 
 void Client::Impl::received_response(long id, tg::rest::Response response, Client::Callback cb) {
-    {
-        auto lock = std::unique_lock(_mutex);
-        _requests.erase(std::remove(_requests.begin(), _requests.end(), id), _requests.end());
-    }
     cb(response);
+
+    // we are still inside of the handler call stack, release it later
+    asio::post(*_tp, [this, id] {
+        auto lock = std::unique_lock(_mutex);
+        _requests.remove_if([id](const RequestHandler& h) { return h == id; });
+    });
 }
 
 void Client::Impl::get_async(const Request& request, Client::Callback getCallback) {
@@ -292,10 +451,14 @@ void Client::Impl::get_async(const Request& request, Client::Callback getCallbac
        received_response(id, std::move(r), cb);
     };
 
-    auto lock = std::unique_lock(_mutex);
     _logger->info("GET: {}", request.get_url().data());
-    RequestHandler& handler = _requests.emplace_back(request, http::verb::get, _tp->get_executor());
-    handler.send_async(std::move(callbackFunction));
+    RequestHandler* handler = nullptr;
+    {
+        // list nodes do not move, handler is removed only after its callback has run
+        auto lock = std::unique_lock(_mutex);
+        handler = &_requests.emplace_back(request, http::verb::get, _tp->get_executor(), _sslContext, _pool);
+    }
+    handler->send_async(std::move(callbackFunction));
 }
 
 void Client::Impl::post_async(const Request& request, Client::Callback postCallback) {
@@ -304,26 +467,36 @@ void Client::Impl::post_async(const Request& request, Client::Callback postCallb
         received_response(id, std::move(r), cb);
     };
 
-    auto lock = std::unique_lock(_mutex);
     _logger->info("POST: {}", request.get_url().data());
-    RequestHandler& handler = _requests.emplace_back(request, http::verb::post, _tp->get_executor());
-    handler.send_async(std::move(callbackFunction));
+    RequestHandler* handler = nullptr;
+    {
+        // list nodes do not move, handler is removed only after its callback has run
+        auto lock = std::unique_lock(_mutex);
+        handler = &_requests.emplace_back(request, http::verb::post, _tp->get_executor(), _sslContext, _pool);
+    }
+    handler->send_async(std::move(callbackFunction));
+}
+
+void Client::Impl::shutdown() {
+    _tp->stop();
+    _tp->join();
+    _pool.clear();
 }
 
 Response Client::Impl::get(const Request& request) {
     _logger->info("GET: {}", request.get_url().data());
-    return RequestHandler{request, http::verb::get, _tp->get_executor()}.send();
+    return RequestHandler{request, http::verb::get, _tp->get_executor(), _sslContext, _pool}.send();
 }
 
 Response Client::Impl::post(const Request& request) {
     _logger->info("POST: {}", request.get_url().data());
-    return RequestHandler{request, http::verb::post, _tp->get_executor()}.send();
+    return RequestHandler{request, http::verb::post, _tp->get_executor(), _sslContext, _pool}.send();
 }
 
 #pragma endregion // Client Implementation
 
-Client::Client()
-    : _impl{ new Impl() }
+Client::Client(std::size_t numThreads)
+    : _impl{ new Impl(numThreads) }
 {}
 
 void Client::get_async(const tg::rest::Request& request, Callback cb) {
@@ -342,6 +515,10 @@ Response Client::post(const tg::rest::Request& request) {
     return _impl->post(request);
 }
 
+void Client::shutdown() {
+    _impl->shutdown();
+}
+
 Client::~Client() = default;
 }
 
@@ -0,0 +1,287 @@
+#include "tgapi/bot/session_store.h"
+
+#include "sqlite/sqlite.h"
+#include "util.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <stdexcept>
+#include <unordered_map>
+#include <vector>
+
+namespace tg {
+
+namespace {
+
+constexpr std::size_t SHARD_BITS = 6;
+constexpr std::size_t SHARD_COUNT = std::size_t{ 1 } << SHARD_BITS;
+
+struct SessionKeyHash {
+    std::size_t operator()(const SessionKey& key) const {
+        return static_cast<std::size_t>(static_cast<std::uint64_t>(key.ChatId) * 0x9E3779B97F4A7C15ull
+            ^ static_cast<std::uint64_t>(key.UserId));
+    }
+};
+
+long unix_time_ms(std::chrono::system_clock::time_point time) {
+    return static_cast<long>(std::chrono::duration_cast<std::chrono::milliseconds>(time.time_since_epoch()).count());
+}
+
+}
+
+class SessionStore::Impl {
+public:
+
+    struct Entry {
+        std::any Value;
+        std::string Blob;                               // stored data which is not decoded yet
+        detail::SessionEncoder Encoder { nullptr };
+        Clock::time_point LastAccess;
+        Clock::time_point Saved;                        // last access written to the database
+        bool Dirty { false };                           // changed since the last flush
+    };
+
+    struct Shard {
+        std::mutex Mutex;
+        std::unordered_map<SessionKey, Entry, SessionKeyHash> Entries;
+        std::vector<SessionKey> Erased;
+    };
+
+    // pending database change
+    struct Row {
+        SessionKey Key;
+        std::string Data;
+        long Updated { 0 };
+        bool Remove { false };
+    };
+
+    explicit Impl(std::chrono::milliseconds ttl)
+        : Ttl{ ttl }
+    {}
+
+    Shard& shard_of(const SessionKey& key) {
+        // all sessions of a chat live in one shard, so chats do not contend with each other
+        const auto hash = static_cast<std::uint64_t>(key.ChatId) * 0x9E3779B97F4A7C15ull;
+        return Shards[hash >> (64 - SHARD_BITS)];
+    }
+
+    bool is_expired(const Entry& entry, Clock::time_point now) const {
+        return now - entry.LastAccess > Ttl;
+    }
+
+    void write_rows() {
+        if (PendingRows.empty()) {
+            return;
+        }
+
+        auto transaction = Db->transaction();
+        for (const auto& row : PendingRows) {
+            if (row.Remove) {
+                Db->prepare("DELETE FROM sessions WHERE chat = ? AND user = ?")
+                    .with_value(0, row.Key.ChatId)
+                    .with_value(1, row.Key.UserId)
+                    .execute();
+            } else {
+                Db->prepare("INSERT OR REPLACE INTO sessions VALUES(?, ?, ?, ?)")
+                    .with_value(0, row.Key.ChatId)
+                    .with_value(1, row.Key.UserId)
+                    .with_value(2, row.Data)
+                    .with_value(3, row.Updated)
+                    .execute();
+            }
+        }
+        transaction.commit();
+        PendingRows.clear();
+    }
+
+    const std::chrono::milliseconds Ttl;
+    std::array<Shard, SHARD_COUNT> Shards;
+
+    std::atomic<bool> Persistent { false };
+    std::mutex DbMutex;
+    UniquePtr<sqlite::Database> Db;
+    std::vector<Row> PendingRows;   // kept until written, so failed flush is retried
+};
+
+SessionStore::SessionStore(std::chrono::milliseconds ttl)
+    : _impl{ make_unique<Impl>(ttl) }
+{}
+
+SessionStore::~SessionStore() = default;
+
+bool SessionStore::load(const SessionKey& key, std::any& value, detail::SessionFunctions functions) {
+    const auto now = Clock::now();
+    auto& shard = _impl->shard_of(key);
+    std::lock_guard lock{ shard.Mutex };
+
+    auto it = shard.Entries.find(key);
+    if (it == shard.Entries.end()) {
+        return false;
+    }
+    auto& entry = it->second;
+    if (_impl->is_expired(entry, now)) {
+        // expired rows are removed from the database by flush
+        shard.Entries.erase(it);
+        return false;
+    }
+
+    if (!entry.Value.has_value()) {
+        if (functions.Decode == nullptr || !functions.Decode(entry.Blob, entry.Value)) {
+            return false;
+        }
+        entry.Blob.clear();
+        entry.Blob.shrink_to_fit();
+        entry.Encoder = functions.Encode;
+    }
+
+    entry.LastAccess = now;
+    if (!entry.Dirty && entry.Encoder != nullptr && now - entry.Saved > _impl->Ttl / 2
+        && _impl->Persistent.load(std::memory_order_relaxed)) {
+        // session which is only read must not expire in the database while it is used
+        entry.Dirty = true;
+    }
+    value = entry.Value;
+    return true;
+}
+
+void SessionStore::store(const SessionKey& key, std::any value, detail::SessionFunctions functions) {
+    const auto now = Clock::now();
+    auto& shard = _impl->shard_of(key);
+    std::lock_guard lock{ shard.Mutex };
+
+    auto& entry = shard.Entries[key];
+    entry.Value = std::move(value);
+    entry.Blob.clear();
+    entry.Encoder = functions.Encode;
+    entry.LastAccess = now;
+    // state without codec also replaces the stored one, flush deletes its row
+    entry.Dirty = _impl->Persistent.load(std::memory_order_relaxed);
+}
+
+bool SessionStore::erase(const SessionKey& key) {
+    auto& shard = _impl->shard_of(key);
+    std::lock_guard lock{ shard.Mutex };
+
+    if (shard.Entries.erase(key) == 0) {
+        return false;
+    }
+    if (_impl->Persistent.load(std::memory_order_relaxed)) {
+        shard.Erased.push_back(key);
+    }
+    return true;
+}
+
+std::size_t SessionStore::size() const {
+    std::size_t size = 0;
+    for (auto& shard : _impl->Shards) {
+        std::lock_guard lock{ shard.Mutex };
+        size += shard.Entries.size();
+    }
+    return size;
+}
+
+void SessionStore::open_store(std::string_view database) {
+    std::lock_guard dbLock{ _impl->DbMutex };
+    if (_impl->Db) {
+        throw std::logic_error("session store is already opened");
+    }
+
+    // database wrapper opens existing files only
+    const auto path = util::get_executable_path() / database;
+    if (!std::filesystem::exists(path)) {
+        std::ofstream{ path };
+    }
+
+    auto db = make_unique<sqlite::Database>();
+    db->open(database);
+    db->prepare("CREATE TABLE IF NOT EXISTS sessions ("
+                "chat INTEGER NOT NULL, user INTEGER NOT NULL, data TEXT NOT NULL, updated INTEGER NOT NULL, "
+                "PRIMARY KEY(chat, user))").execute();
+
+    const auto steadyNow = Clock::now();
+    const long unixNow = unix_time_ms(std::chrono::system_clock::now());
+    db->prepare("DELETE FROM sessions WHERE updated < ?")
+        .with_value(0, unixNow - static_cast<long>(_impl->Ttl.count()))
+        .execute();
+
+    // loaded sessions are decoded on first access, a miss never queries the database
+    auto stmt = db->prepare("SELECT chat, user, data, updated FROM sessions");
+    auto reader = stmt.fetch<long, long, std::string, long>();
+    while (reader.read()) {
+        auto [chat, user, data, updated] = reader.fetch();
+        const SessionKey key{ chat, user };
+        auto& shard = _impl->shard_of(key);
+        std::lock_guard lock{ shard.Mutex };
+
+        auto [it, inserted] = shard.Entries.try_emplace(key);
+        if (inserted) {
+            it->second.Blob = std::move(data);
+            it->second.LastAccess = steadyNow - std::chrono::milliseconds(std::max(unixNow - updated, 0L));
+            it->second.Saved = it->second.LastAccess;
+        }
+    }
+
+    _impl->Db = std::move(db);
+    _impl->Persistent.store(true, std::memory_order_relaxed);
+}
+
+void SessionStore::flush() {
+    if (!_impl->Persistent.load(std::memory_order_relaxed)) {
+        return;
+    }
+
+    const auto steadyNow = Clock::now();
+    const long unixNow = unix_time_ms(std::chrono::system_clock::now());
+
+    std::lock_guard dbLock{ _impl->DbMutex };
+    for (auto& shard : _impl->Shards) {
+        std::lock_guard lock{ shard.Mutex };
+        for (const auto& key : shard.Erased) {
+            _impl->PendingRows.push_back(Impl::Row{ key, {}, 0, true });
+        }
+        shard.Erased.clear();
+
+        for (auto& [key, entry] : shard.Entries) {
+            if (!entry.Dirty) {
+                continue;
+            }
+            entry.Dirty = false;
+            if (entry.Encoder == nullptr) {
+                _impl->PendingRows.push_back(Impl::Row{ key, {}, 0, true });
+                continue;
+            }
+
+            const auto age = std::chrono::duration_cast<std::chrono::milliseconds>(steadyNow - entry.LastAccess);
+            entry.Saved = entry.LastAccess;
+            _impl->PendingRows.push_back(Impl::Row{ key, entry.Encoder(entry.Value), unixNow - static_cast<long>(age.count()), false });
+        }
+    }
+
+    _impl->write_rows();
+    _impl->Db->prepare("DELETE FROM sessions WHERE updated < ?")
+        .with_value(0, unixNow - static_cast<long>(_impl->Ttl.count()))
+        .execute();
+}
+
+std::size_t SessionStore::evict_expired(Clock::time_point now) {
+    std::size_t evicted = 0;
+    for (auto& shard : _impl->Shards) {
+        std::lock_guard lock{ shard.Mutex };
+        for (auto it = shard.Entries.begin(); it != shard.Entries.end();) {
+            // changed sessions stay until they are flushed
+            if (!it->second.Dirty && _impl->is_expired(it->second, now)) {
+                it = shard.Entries.erase(it);
+                ++evicted;
+            } else {
+                ++it;
+            }
+        }
+    }
+    return evicted;
+}
+
+}
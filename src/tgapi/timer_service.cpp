@@ -0,0 +1,1069 @@
+#include "tgapi/bot/timer_service.h"
+#include "tgapi/bot/timing_wheel.h"
+
+#include "log/logging.h"
+#include "sqlite/sqlite.h"
+#include "util.h"
+
+#include <atomic>
+#include <cassert>
+#include <condition_variable>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
+#include <thread>
+#include <unordered_map>
+#include <boost/asio/post.hpp>
+#include <boost/asio/thread_pool.hpp>
+
+namespace tg
+{
+
+namespace detail {
+
+struct TimerEntry {
+    long Key { 0 };         // durable timers only
+    SharedPtr<std::function<void(TimerReply&)>> Callback;
+    SharedPtr<const CronSchedule> Cron;     // cron timers only
+    TimerDuration Interval { 0 };
+    TimerDuration Slack { 0 };
+    bool Looping { false };
+    bool Running { false };
+    bool Durable { false };
+};
+
+struct StoredTimer {
+    long Key { 0 };
+    std::string Callback;
+    std::string Payload;
+    long Due { 0 };         // unix time, ms
+    long Interval { 0 };    // ms
+    bool Looping { false };
+};
+
+/**
+ * Timer definitions stored in SQLite
+ */
+class TimerStore {
+public:
+
+    explicit TimerStore(std::string_view database) {
+        // database wrapper opens existing files only
+        const auto path = util::get_executable_path() / database;
+        if (!std::filesystem::exists(path)) {
+            std::ofstream{ path };
+        }
+
+        _db.open(database);
+        _db.prepare("CREATE TABLE IF NOT EXISTS timers ("
+                    "handle INTEGER PRIMARY KEY, callback TEXT NOT NULL, payload TEXT NOT NULL, "
+                    "due INTEGER NOT NULL, interval INTEGER NOT NULL, looping INTEGER NOT NULL)").execute();
+        _db.prepare("CREATE INDEX IF NOT EXISTS timers_due ON timers(due)").execute();
+    }
+
+    void save(const StoredTimer& t) {
+        _db.prepare("INSERT OR REPLACE INTO timers VALUES(?, ?, ?, ?, ?, ?)")
+            .with_value(0, t.Key)
+            .with_value(1, t.Callback)
+            .with_value(2, t.Payload)
+            .with_value(3, t.Due)
+            .with_value(4, t.Interval)
+            .with_value(5, t.Looping)
+            .execute();
+    }
+
+    void remove(long key) {
+        _db.prepare("DELETE FROM timers WHERE handle = ?")
+            .with_value(0, key)
+            .execute();
+    }
+
+    void reschedule(long key, long due, long interval) {
+        _db.prepare("UPDATE timers SET due = ?, interval = ? WHERE handle = ?")
+            .with_value(0, due)
+            .with_value(1, interval)
+            .with_value(2, key)
+            .execute();
+    }
+
+    std::vector<StoredTimer> load(std::optional<long> from, long to) {
+        auto stmt = from
+            ? _db.prepare("SELECT handle, callback, payload, due, interval, looping FROM timers WHERE due >= ? AND due < ?")
+            : _db.prepare("SELECT handle, callback, payload, due, interval, looping FROM timers WHERE due < ?");
+        if (from) {
+            stmt.with_value(0, *from).with_value(1, to);
+        } else {
+            stmt.with_value(0, to);
+        }
+
+        std::vector<StoredTimer> result;
+        auto reader = stmt.fetch<long, std::string, std::string, long, long, long>();
+        while (reader.read()) {
+            auto [key, callback, payload, due, interval, looping] = reader.fetch();
+            result.push_back(StoredTimer{ key, std::move(callback), std::move(payload), due, interval, looping != 0 });
+        }
+        return result;
+    }
+
+    std::optional<StoredTimer> load_one(long key) {
+        auto stmt = _db.prepare("SELECT handle, callback, payload, due, interval, looping FROM timers WHERE handle = ?");
+        stmt.with_value(0, key);
+
+        auto reader = stmt.fetch<long, std::string, std::string, long, long, long>();
+        if (!reader.read()) {
+            return std::nullopt;
+        }
+        auto [h, callback, payload, due, interval, looping] = reader.fetch();
+        return StoredTimer{ h, std::move(callback), std::move(payload), due, interval, looping != 0 };
+    }
+
+private:
+    sqlite::Database _db;
+};
+
+}
+
+class TimerService::Impl {
+
+    struct UnregisteredCallback : std::runtime_error {
+        using std::runtime_error::runtime_error;
+    };
+
+    using ClockType = std::chrono::steady_clock;
+    using Wheel = TimingWheel<detail::TimerEntry>;
+
+    struct ExpiredTimer {
+        TimerHandle Handle;
+        bool Durable;
+        long Key;
+        Wheel::Tick Expiry;
+        SharedPtr<std::function<void(TimerReply&)>> Callback;
+    };
+
+    /**
+     * Cron timers with the same schedule, fired by a single wheel entry
+     */
+    struct CronGroup {
+        SharedPtr<const CronSchedule> Schedule;
+        Wheel::Index Index { Wheel::NIL };
+        std::unordered_map<CronTimerId, SharedPtr<std::function<void(TimerReply&)>>> Timers;
+    };
+
+    static constexpr Wheel::Tick NEVER = ~Wheel::Tick{ 0 };
+
+    [[nodiscard]] ClockType::time_point now() const {
+        return _clock ? _clock->now() : ClockType::now();
+    }
+
+    [[nodiscard]] Wheel::Tick now_tick() const {
+        return static_cast<Wheel::Tick>(std::chrono::duration_cast<TimerDuration>(now() - _start).count());
+    }
+
+    [[nodiscard]] Wheel::Tick tick_after(TimerDuration interval) const {
+        return now_tick() + static_cast<Wheel::Tick>(std::max(interval.count(), TimerDuration::rep{ 0 }));
+    }
+
+    /**
+     * Pick the tick with most trailing zero bits within the slack window,
+     * timers with overlapping windows mostly end up on the same tick
+     */
+    [[nodiscard]] Wheel::Tick tick_after(TimerDuration interval, TimerDuration slack) const {
+        const auto earliest = tick_after(interval);
+        if (slack.count() <= 0) {
+            return earliest;
+        }
+
+        const auto latest = earliest + static_cast<Wheel::Tick>(slack.count());
+        // highest bit where the bounds differ is set in latest and clear in earliest
+        const auto bit = detail::highest_bit(earliest ^ latest);
+        return latest & ~((Wheel::Tick{ 1 } << bit) - 1);
+    }
+
+    [[nodiscard]] ClockType::time_point time_of(Wheel::Tick tick) const {
+        return _start + TimerDuration(tick);
+    }
+
+    // stored timers keep wall clock time, it is mapped onto ticks once per run
+    [[nodiscard]] long unix_of(Wheel::Tick tick) const {
+        return _unixAtStart + static_cast<long>(tick);
+    }
+
+    [[nodiscard]] Wheel::Tick tick_of(long unixMs) const {
+        return static_cast<Wheel::Tick>(std::max(unixMs - _unixAtStart, 0l));
+    }
+
+    [[nodiscard]] TimerHandle handle_of(Wheel::Index index) const {
+        return TimerHandle{ index, _wheel.generation(index) };
+    }
+
+    [[nodiscard]] bool is_current(TimerHandle h) const {
+        return h.is_valid() && _wheel.is_current(h.index(), h.generation());
+    }
+
+    /**
+     * Check if handle refers to existing timer added with add_timer
+     */
+    [[nodiscard]] bool is_plain(TimerHandle h) const {
+        if (!is_current(h)) {
+            return false;
+        }
+        const auto& data = _wheel.get(h.index());
+        return !data.Durable && !data.Cron;
+    }
+
+    [[nodiscard]] std::optional<Wheel::Tick> cron_tick(const CronSchedule& schedule) const {
+        if (auto next = schedule.next_after(unix_of(now_tick()))) {
+            return tick_of(*next);
+        }
+        return std::nullopt;
+    }
+
+    void notify() {
+        _dirty = true;
+        _cv.notify_one();
+    }
+
+    /**
+     * Wake the timer thread only if it sleeps past the expiry
+     */
+    void notify(Wheel::Tick expiry) {
+        if (expiry < _waitUntil) {
+            _waitUntil = expiry;
+            notify();
+        }
+    }
+
+    void release(Wheel::Index index) {
+        const auto& data = _wheel.get(index);
+        if (data.Durable) {
+            _durableKeys.erase(data.Key);
+        }
+        if (data.Cron) {
+            if (auto it = _cronGroups.find(data.Cron->key()); it != _cronGroups.end()) {
+                for (const auto& [id, cb] : it->second->Timers) {
+                    _cronIds.erase(id);
+                }
+                _cronGroups.erase(it);
+            }
+        }
+        _wheel.release(index);
+    }
+
+    Wheel::Index schedule(TimerSpec spec) {
+        detail::TimerEntry entry;
+        entry.Callback = make_shared<std::function<void(TimerReply&)>>(std::move(spec.Callback));
+        entry.Interval = spec.Interval;
+        entry.Slack = spec.Slack;
+        entry.Looping = spec.Looping;
+
+        const auto expiry = tick_after(entry.Interval, entry.Slack);
+        notify(expiry);
+        return _wheel.schedule(expiry, std::move(entry));
+    }
+
+    /**
+     * Advance the wheel to the current time and mark expired timers as running. Service lock must be held
+     */
+    std::vector<ExpiredTimer> expire() {
+        _expired.clear();
+        _wheel.advance(now_tick(), _expired);
+
+        std::vector<ExpiredTimer> batch;
+        batch.reserve(_expired.size());
+        for (auto index : _expired) {
+            auto& entry = _wheel.get(index);
+            entry.Running = true;
+            batch.push_back(ExpiredTimer{ handle_of(index), entry.Durable, entry.Key, _wheel.expiry(index), entry.Callback });
+        }
+        _running += batch.size();
+        return batch;
+    }
+
+    void run_callbacks(const std::vector<ExpiredTimer>& batch) {
+        for (const auto& t : batch) {
+            run_callback(t.Handle, t.Durable, t.Key, t.Expiry, *t.Callback);
+        }
+    }
+
+    void post_callbacks(std::vector<ExpiredTimer> batch) {
+        if (batch.empty()) {
+            return;
+        }
+
+        // timers expired at once are run by a single job
+        boost::asio::post(_executor, [this, guard = _guard, batch = std::move(batch)] {
+            // executor may run the callbacks after service is destroyed
+            std::shared_lock alive{ guard->Mutex };
+            if (guard->Alive) {
+                run_callbacks(batch);
+            }
+        });
+    }
+
+    /**
+     * Get tick to page in the next part of the horizon at. Service lock must be held
+     */
+    [[nodiscard]] std::optional<Wheel::Tick> page_at() const {
+        if (!_store || _isPaging) {
+            return std::nullopt;
+        }
+        // page in once half of the horizon has passed
+        return _loadedUntil - std::min<Wheel::Tick>(_loadedUntil, _horizon.count() / 2);
+    }
+
+    void count_wakeup() {
+        ++_metrics.Wakeups;
+
+        const auto second = now_tick() / 1000;
+        if (second != _wakeupSecond) {
+            _wakeupsLastSecond = second == _wakeupSecond + 1 ? _wakeupsThisSecond : 0;
+            _wakeupsThisSecond = 0;
+            _wakeupSecond = second;
+        }
+        ++_wakeupsThisSecond;
+    }
+
+    void run_callback(TimerHandle handle, bool durable, long key, Wheel::Tick expiry,
+                      const std::function<void(TimerReply&)>& callback) {
+        {
+            std::unique_lock lock{ _mutex };
+            if (_isStopping) {
+                --_running;
+                return;
+            }
+
+            const auto now = now_tick();
+            const auto lag = TimerDuration(now - std::min(expiry, now));
+            _metrics.LastLag = lag;
+            _metrics.MaxLag = std::max(_metrics.MaxLag, lag);
+            _metrics.TotalLag += lag;
+            ++_metrics.Fired;
+        }
+
+        TimerReply r{ handle };
+        bool keepStored = false;
+        try {
+            callback(r);
+        } catch (const UnregisteredCallback& e) {
+            keepStored = true;
+            _logger->error("Timer {}: {}", key, e.what());
+        } catch (const std::exception& e) {
+            _logger->error("Exception occurred in timer: {}", e.what());
+        }
+
+        // stored timer is updated under the store lock, so paging cannot miss it
+        std::unique_lock storeLock{ _storeMutex, std::defer_lock };
+        if (durable) {
+            storeLock.lock();
+        }
+        std::unique_lock lock{ _mutex };
+        --_running;
+
+        if (!is_current(handle)) {
+            return; // deleted or replaced while running
+        }
+
+        const auto index = handle.index();
+        auto& data = _wheel.get(index);
+        data.Running = false;
+
+        if (keepStored) {
+            // stored timer fires again once its callback is registered after restart
+            release(index);
+            return;
+        }
+
+        if (r.is_delete()) {
+            release(index);
+            lock.unlock();
+
+            if (durable) {
+                store_remove(key);
+            }
+            return;
+        }
+
+        if (data.Cron) {
+            if (auto next = cron_tick(*data.Cron)) {
+                _wheel.reschedule(index, *next);
+                notify(*next);
+            } else {
+                release(index);
+            }
+            return;
+        }
+
+        if (r.is_interval()) {
+            data.Interval = r.interval();
+        }
+
+        if (data.Looping) {
+            const auto next = tick_after(data.Interval, data.Slack);
+            const auto interval = data.Interval;
+            if (durable && next >= _loadedUntil) {
+                // will be paged in again
+                release(index);
+            } else {
+                _wheel.reschedule(index, next);
+                notify(next);
+            }
+            lock.unlock();
+
+            if (durable) {
+                store_reschedule(key, unix_of(next), interval);
+            }
+        } else if (!_wheel.is_scheduled(index)) {
+            // timer has expired
+            release(index);
+            lock.unlock();
+
+            if (durable) {
+                store_remove(key);
+            }
+        }
+    }
+
+    void run_cron_group(CronGroup& group, TimerHandle handle) {
+        std::vector<std::pair<CronTimerId, SharedPtr<std::function<void(TimerReply&)>>>> timers;
+        {
+            std::unique_lock lock{ _mutex };
+            timers.assign(group.Timers.begin(), group.Timers.end());
+        }
+
+        std::vector<CronTimerId> deleted;
+        for (const auto& [id, callback] : timers) {
+            TimerReply r{ handle };
+            try {
+                (*callback)(r);
+            } catch (const std::exception& e) {
+                _logger->error("Exception occurred in cron timer: {}", e.what());
+            }
+            if (r.is_delete()) {
+                deleted.push_back(id);
+            }
+        }
+
+        if (!deleted.empty()) {
+            std::unique_lock lock{ _mutex };
+            for (auto id : deleted) {
+                erase_cron_timer(id);
+            }
+        }
+    }
+
+    /**
+     * Remove timer from its group, group without timers is released. Service lock must be held
+     */
+    bool erase_cron_timer(CronTimerId id) {
+        auto it = _cronIds.find(id);
+        if (it == _cronIds.end()) {
+            return false;
+        }
+
+        auto group = it->second;
+        group->Timers.erase(id);
+        _cronIds.erase(it);
+        if (group->Timers.empty()) {
+            release(group->Index);
+        }
+        return true;
+    }
+
+    void worker_thread() {
+        std::unique_lock lock { _mutex };
+
+        while (!_isStopping) {
+            post_callbacks(expire());
+
+            std::optional<Wheel::Tick> next = _wheel.next_deadline();
+
+            if (auto pageAt = page_at()) {
+                if (now_tick() >= *pageAt) {
+                    _isPaging = true;
+                    boost::asio::post(_executor, [this, guard = _guard] {
+                        std::shared_lock alive{ guard->Mutex };
+                        if (guard->Alive) {
+                            page_in();
+                        }
+                    });
+                } else {
+                    next = next ? std::min(*next, *pageAt) : *pageAt;
+                }
+            }
+
+            _dirty = false;
+            _waitUntil = next.value_or(NEVER);
+            if (!next) {
+                _cv.wait(lock, [this] {
+                    return _dirty || _isStopping;
+                });
+            } else {
+                // tick N starts exactly at start + N ms, so waking up at that point always finds the timer due
+                _cv.wait_until(lock, time_of(*next), [this] {
+                    return _dirty || _isStopping;
+                });
+            }
+            _waitUntil = 0;
+            count_wakeup();
+        }
+    }
+
+    /**
+     * Schedule stored timer in memory. Both store and service locks must be held
+     */
+    void schedule_stored(const detail::StoredTimer& t) {
+        if (_durableKeys.count(t.Key) != 0) {
+            return;
+        }
+
+        detail::TimerEntry entry;
+        entry.Key = t.Key;
+        entry.Interval = TimerDuration(t.Interval);
+        entry.Looping = t.Looping;
+        entry.Durable = true;
+        entry.Callback = make_shared<std::function<void(TimerReply&)>>(
+            [this, name = t.Callback, payload = t.Payload](TimerReply& r) {
+                run_durable_callback(name, payload, r);
+            });
+
+        _durableKeys.emplace(t.Key, _wheel.schedule(tick_of(t.Due), std::move(entry)));
+    }
+
+    void run_durable_callback(const std::string& name, const std::string& payload, TimerReply& r) {
+        DurableCallback cb;
+        {
+            std::shared_lock lock{ _registryMutex };
+            auto it = _registry.find(name);
+            if (it != _registry.end()) {
+                cb = it->second;
+            }
+        }
+
+        if (!cb) {
+            throw UnregisteredCallback(fmt::format(R"(callback "{}" is not registered)", name));
+        }
+        cb(r, payload);
+    }
+
+    void page_in() {
+        std::unique_lock storeLock{ _storeMutex };
+
+        const auto until = tick_after(_horizon);
+        std::vector<detail::StoredTimer> timers;
+        try {
+            timers = _store->load(unix_of(_loadedUntil), unix_of(until));
+        } catch (const std::exception& e) {
+            _logger->error("Failed to page in timers: {}", e.what());
+        }
+
+        std::unique_lock lock{ _mutex };
+        for (const auto& t : timers) {
+            schedule_stored(t);
+        }
+        _loadedUntil = until;
+        _isPaging = false;
+        notify();
+    }
+
+    void store_remove(long key) {
+        try {
+            _store->remove(key);
+        } catch (const std::exception& e) {
+            _logger->error("Failed to remove stored timer {}: {}", key, e.what());
+        }
+    }
+
+    void store_reschedule(long key, long due, TimerDuration interval) {
+        try {
+            _store->reschedule(key, due, static_cast<long>(interval.count()));
+        } catch (const std::exception& e) {
+            _logger->error("Failed to update stored timer {}: {}", key, e.what());
+        }
+    }
+
+    bool update_entry(Wheel::Index index, TimerDuration interval) {
+        auto& data = _wheel.get(index);
+        data.Interval = interval;
+        if (!data.Running) {
+            // running looping timer picks new interval up once its callback returns
+            const auto next = tick_after(interval, data.Slack);
+            _wheel.reschedule(index, next);
+            notify(next);
+        }
+        return true;
+    }
+
+public:
+
+    Impl(std::optional<boost::asio::any_io_executor> executor, SharedPtr<TimerClock> clock)
+        : _clock{ std::move(clock) }
+        , _start{ now() }
+    {
+        namespace chrono = std::chrono;
+        _unixAtStart = static_cast<long>(
+            chrono::duration_cast<TimerDuration>(chrono::system_clock::now().time_since_epoch()).count());
+
+        _logger = mylog::LogManager::get().create_logger("Timers");
+
+        if (_clock) {
+            // driven by poll()
+            return;
+        }
+
+        if (executor) {
+            _executor = *executor;
+        } else {
+            _pool = make_unique<boost::asio::thread_pool>(1);
+            _executor = _pool->get_executor();
+        }
+
+        _thread = std::thread{ &Impl::worker_thread, this };
+    }
+
+    Impl(const Impl&) = delete;
+    Impl(Impl&&) = delete;
+    const Impl& operator=(const Impl&) = delete;
+    const Impl& operator=(Impl&&) = delete;
+
+    TimerHandle add_timer(std::function<void(TimerReply&)> callback, TimerDuration interval, bool looping, TimerDuration slack) {
+        std::unique_lock lock{ _mutex };
+        return handle_of(schedule(TimerSpec{ std::move(callback), interval, looping, slack }));
+    }
+
+    std::vector<TimerHandle> add_timers(std::vector<TimerSpec> timers) {
+        std::vector<TimerHandle> handles;
+        handles.reserve(timers.size());
+
+        std::unique_lock lock{ _mutex };
+        for (auto& spec : timers) {
+            handles.push_back(handle_of(schedule(std::move(spec))));
+        }
+        return handles;
+    }
+
+    bool update_timer(TimerHandle handle, TimerDuration interval) {
+        std::unique_lock lock{ _mutex };
+        if (!is_plain(handle)) {
+            return false;
+        }
+        return update_entry(handle.index(), interval);
+    }
+
+    bool delete_timer(TimerHandle handle) {
+        std::unique_lock lock{ _mutex };
+        if (!is_plain(handle)) {
+            return false;
+        }
+        // timer thread finds nothing at the old deadline and goes back to sleep
+        _wheel.release(handle.index());
+        return true;
+    }
+
+    std::size_t delete_timers(const std::vector<TimerHandle>& handles) {
+        std::size_t deleted = 0;
+
+        std::unique_lock lock{ _mutex };
+        for (const auto& handle : handles) {
+            if (is_plain(handle)) {
+                _wheel.release(handle.index());
+                ++deleted;
+            }
+        }
+        return deleted;
+    }
+
+    CronTimerId add_cron_timer(const CronSchedule& schedule, std::function<void(TimerReply&)> callback) {
+        std::unique_lock lock{ _mutex };
+
+        auto it = _cronGroups.find(schedule.key());
+        if (it == _cronGroups.end()) {
+            const auto next = cron_tick(schedule);
+            if (!next) {
+                throw std::runtime_error("cron schedule never fires");
+            }
+
+            auto group = make_shared<CronGroup>();
+            group->Schedule = make_shared<const CronSchedule>(schedule);
+
+            detail::TimerEntry entry;
+            entry.Cron = group->Schedule;
+            entry.Looping = true;
+            entry.Callback = make_shared<std::function<void(TimerReply&)>>([this, group](TimerReply& r) {
+                run_cron_group(*group, r.handle());
+            });
+
+            group->Index = _wheel.schedule(*next, std::move(entry));
+            notify(*next);
+            it = _cronGroups.emplace(schedule.key(), std::move(group)).first;
+        }
+
+        const auto id = _nextCronId++;
+        it->second->Timers.emplace(id, make_shared<std::function<void(TimerReply&)>>(std::move(callback)));
+        _cronIds.emplace(id, it->second);
+        return id;
+    }
+
+    bool delete_cron_timer(CronTimerId id) {
+        std::unique_lock lock{ _mutex };
+        return erase_cron_timer(id);
+    }
+
+    void register_callback(std::string name, DurableCallback callback) {
+        std::unique_lock lock{ _registryMutex };
+        _registry[std::move(name)] = std::move(callback);
+    }
+
+    void open_store(std::string_view database, TimerDuration horizon) {
+        std::unique_lock storeLock{ _storeMutex };
+        if (_store) {
+            throw std::runtime_error("timer store is already open");
+        }
+
+        auto store = make_unique<detail::TimerStore>(database);
+
+        const auto until = tick_after(horizon);
+        auto timers = store->load(std::nullopt, unix_of(until));
+
+        std::unique_lock lock{ _mutex };
+        _store = std::move(store);
+        _horizon = horizon;
+        _loadedUntil = until;
+        for (const auto& t : timers) {
+            schedule_stored(t);
+        }
+        notify();
+
+        _logger->info(R"(Opened timer store "{}", loaded {} timers within {}ms)", database, timers.size(), horizon.count());
+    }
+
+    void add_durable_timer(std::string_view callbackName, std::string payload, long key, TimerDuration interval, bool looping) {
+        std::unique_lock storeLock{ _storeMutex };
+        if (!_store) {
+            throw std::runtime_error("timer store is not open");
+        }
+
+        const auto next = tick_after(interval);
+
+        detail::StoredTimer t;
+        t.Key = key;
+        t.Callback = callbackName;
+        t.Payload = std::move(payload);
+        t.Due = unix_of(next);
+        t.Interval = static_cast<long>(interval.count());
+        t.Looping = looping;
+        _store->save(t);
+
+        std::unique_lock lock{ _mutex };
+        auto it = _durableKeys.find(key);
+        if (it != _durableKeys.end()) {
+            release(it->second);
+        }
+        if (next < _loadedUntil) {
+            schedule_stored(t);
+            notify(next);
+        }
+    }
+
+    void update_durable_timer(long key, TimerDuration interval) {
+        std::unique_lock storeLock{ _storeMutex };
+        if (!_store) {
+            throw std::runtime_error("timer store is not open");
+        }
+
+        const auto next = tick_after(interval);
+        store_reschedule(key, unix_of(next), interval);
+
+        std::unique_lock lock{ _mutex };
+        auto it = _durableKeys.find(key);
+        if (it != _durableKeys.end()) {
+            update_entry(it->second, interval);
+            return;
+        }
+
+        if (next < _loadedUntil) {
+            // timer was beyond the horizon
+            lock.unlock();
+            std::optional<detail::StoredTimer> stored;
+            try {
+                stored = _store->load_one(key);
+            } catch (const std::exception& e) {
+                _logger->error("Failed to load stored timer {}: {}", key, e.what());
+            }
+
+            lock.lock();
+            if (stored) {
+                schedule_stored(*stored);
+                notify();
+            }
+        }
+    }
+
+    void delete_durable_timer(long key) {
+        std::unique_lock storeLock{ _storeMutex };
+        if (!_store) {
+            throw std::runtime_error("timer store is not open");
+        }
+
+        {
+            std::unique_lock lock{ _mutex };
+            auto it = _durableKeys.find(key);
+            if (it != _durableKeys.end()) {
+                release(it->second);
+            }
+        }
+
+        store_remove(key);
+    }
+
+    std::size_t size() const {
+        std::unique_lock lock{ _mutex };
+        return _wheel.size();
+    }
+
+    TimerMetrics get_metrics() const {
+        std::unique_lock lock{ _mutex };
+        TimerMetrics m = _metrics;
+        m.Pending = _wheel.size();
+        m.Running = _running;
+
+        const auto second = now_tick() / 1000;
+        if (second == _wakeupSecond) {
+            m.WakeupsPerSecond = _wakeupsLastSecond;
+        } else if (second == _wakeupSecond + 1) {
+            m.WakeupsPerSecond = _wakeupsThisSecond;
+        }
+        return m;
+    }
+
+    std::size_t poll() {
+        if (!_clock) {
+            throw std::runtime_error("timer service is not driven manually");
+        }
+
+        std::vector<ExpiredTimer> batch;
+        bool pageIn = false;
+        {
+            std::unique_lock lock{ _mutex };
+            if (_isStopping) {
+                return 0;
+            }
+
+            batch = expire();
+            ++_metrics.Wakeups;
+
+            if (auto pageAt = page_at(); pageAt && now_tick() >= *pageAt) {
+                _isPaging = pageIn = true;
+            }
+        }
+
+        run_callbacks(batch);
+        if (pageIn) {
+            page_in();
+        }
+        return batch.size();
+    }
+
+    std::optional<TimerDuration> next_timeout() const {
+        std::unique_lock lock{ _mutex };
+        if (auto next = _wheel.next_deadline()) {
+            return TimerDuration(*next - std::min(*next, now_tick()));
+        }
+        return std::nullopt;
+    }
+
+    void shutdown() {
+        {
+            std::unique_lock lock { _mutex };
+            _isStopping = true;
+            _cv.notify_one();
+        }
+
+        if (_thread.joinable() && _thread.get_id() != std::this_thread::get_id()) {
+            _thread.join();
+        }
+
+        if (_pool) {
+            _pool->stop();
+            _pool->join();
+        }
+    }
+
+    ~Impl() {
+        shutdown();
+
+        // waits for callbacks which are running on external executor
+        std::unique_lock lock{ _guard->Mutex };
+        _guard->Alive = false;
+    }
+
+private:
+    std::thread _thread;
+    mutable std::mutex _mutex;
+    std::condition_variable _cv;
+    bool _dirty { false };
+    Wheel::Tick _waitUntil { 0 };   // tick the timer thread sleeps until, 0 while it is awake
+    std::atomic<bool> _isStopping { false };
+
+    struct Guard {
+        std::shared_mutex Mutex;
+        bool Alive { true };
+    };
+    SharedPtr<Guard> _guard { make_shared<Guard>() };
+
+    UniquePtr<boost::asio::thread_pool> _pool;
+    boost::asio::any_io_executor _executor;
+
+    mylog::LoggerPtr _logger;
+
+    SharedPtr<TimerClock> _clock;   // manually driven service only
+    const ClockType::time_point _start;
+    long _unixAtStart { 0 };
+    Wheel _wheel;
+    std::vector<Wheel::Index> _expired;
+
+    // durable timers, store lock is always taken before the service lock
+    std::mutex _storeMutex;
+    UniquePtr<detail::TimerStore> _store;
+    std::unordered_map<long, Wheel::Index> _durableKeys;
+    TimerDuration _horizon { 0 };
+    Wheel::Tick _loadedUntil { 0 };
+    bool _isPaging { false };
+
+    std::unordered_map<std::string, SharedPtr<CronGroup>> _cronGroups;  // by schedule key
+    std::unordered_map<CronTimerId, SharedPtr<CronGroup>> _cronIds;
+    CronTimerId _nextCronId { 1 };
+
+    std::shared_mutex _registryMutex;
+    std::unordered_map<std::string, DurableCallback> _registry;
+
+    std::size_t _running { 0 };
+    TimerMetrics _metrics;
+    Wheel::Tick _wakeupSecond { 0 };
+    std::uint64_t _wakeupsThisSecond { 0 };
+    std::uint64_t _wakeupsLastSecond { 0 };
+};
+
+TimerHandle TimerService::add_timer(std::function<void(TimerReply&)> callback, TimerDuration interval, bool looping,
+                                    TimerDuration slack) {
+    return _impl->add_timer(std::move(callback), interval, looping, slack);
+}
+
+bool TimerService::delete_timer(TimerHandle handle) {
+    return _impl->delete_timer(handle);
+}
+
+bool TimerService::update_timer(TimerHandle handle, TimerDuration interval) {
+    return _impl->update_timer(handle, interval);
+}
+
+std::vector<TimerHandle> TimerService::add_timers(std::vector<TimerSpec> timers) {
+    return _impl->add_timers(std::move(timers));
+}
+
+std::size_t TimerService::delete_timers(const std::vector<TimerHandle>& handles) {
+    return _impl->delete_timers(handles);
+}
+
+TimerService::CronTimerId TimerService::add_cron_timer(const CronSchedule& schedule, std::function<void(TimerReply&)> callback) {
+    return _impl->add_cron_timer(schedule, std::move(callback));
+}
+
+bool TimerService::delete_cron_timer(CronTimerId id) {
+    return _impl->delete_cron_timer(id);
+}
+
+void TimerService::register_callback(std::string name, DurableCallback callback) {
+    _impl->register_callback(std::move(name), std::move(callback));
+}
+
+void TimerService::open_store(std::string_view database, TimerDuration horizon) {
+    _impl->open_store(database, horizon);
+}
+
+void TimerService::add_durable_timer(std::string_view callbackName, std::string payload, long key, TimerDuration interval, bool looping) {
+    _impl->add_durable_timer(callbackName, std::move(payload), key, interval, looping);
+}
+
+void TimerService::update_durable_timer(long key, TimerDuration interval) {
+    _impl->update_durable_timer(key, interval);
+}
+
+void TimerService::delete_durable_timer(long key) {
+    _impl->delete_durable_timer(key);
+}
+
+std::size_t TimerService::size() const {
+    return _impl->size();
+}
+
+TimerMetrics TimerService::get_metrics() const {
+    return _impl->get_metrics();
+}
+
+void TimerService::shutdown() {
+    _impl->shutdown();
+}
+
+std::size_t TimerService::poll() {
+    return _impl->poll();
+}
+
+std::optional<TimerDuration> TimerService::next_timeout() const {
+    return _impl->next_timeout();
+}
+
+TimerService::TimerService()
+    : _impl { new Impl(std::nullopt, nullptr) }
+{}
+
+TimerService::TimerService(boost::asio::any_io_executor executor)
+    : _impl { new Impl(std::move(executor), nullptr) }
+{}
+
+TimerService::TimerService(SharedPtr<TimerClock> clock) {
+    if (!clock) {
+        throw std::runtime_error("timer clock is null");
+    }
+    _impl.reset(new Impl(std::nullopt, std::move(clock)));
+}
+
+TimerService::~TimerService() = default;
+
+
+TimerClock::TimePoint VirtualClock::now() const {
+    return TimePoint(TimePoint::duration(_now.load(std::memory_order_acquire)));
+}
+
+void VirtualClock::advance(TimerDuration duration) {
+    _now.fetch_add(std::chrono::duration_cast<TimePoint::duration>(duration).count(), std::memory_order_acq_rel);
+}
+
+
+TimerReply::TimerReply(TimerHandle handle)
+    : _handle{ handle } {
+
+}
+
+void TimerReply::set_delete() {
+    consume_reply();
+    _delete = true;
+}
+
+void TimerReply::update_interval(TimerDuration interval) {
+    consume_reply();
+    _newInterval = std::max(interval, TimerDuration(1));
+}
+
+void TimerReply::consume_reply() {
+    assert(!_consumed);
+    _consumed = true;
+}
+
+bool TimerReply::is_interval() const { return _newInterval.count() > 0; }
+bool TimerReply::is_delete() const { return _delete; }
+TimerDuration TimerReply::interval() const { return _newInterval; }
+TimerHandle TimerReply::handle() const { return _handle; }
+
+}
@@ -0,0 +1,161 @@
+#include "tgapi/command/trigger_matcher.h"
+
+#include <cctype>
+#include <queue>
+#include <stdexcept>
+
+namespace tg
+{
+
+namespace {
+
+constexpr std::uint32_t NO_STATE = ~std::uint32_t{ 0 };
+
+unsigned char fold(char ch) {
+    return static_cast<unsigned char>(std::tolower(static_cast<unsigned char>(ch)));
+}
+
+bool is_word_byte(char ch) {
+    const auto byte = static_cast<unsigned char>(ch);
+    // bytes of multibyte UTF-8 characters are treated as letters
+    return byte >= 0x80 || std::isalnum(byte) || byte == '_';
+}
+
+}
+
+void TriggerMatcher::add(std::string_view phrase, std::size_t id, bool wholeWord) {
+    if (phrase.empty()) {
+        throw std::runtime_error("trigger phrase is empty");
+    }
+
+    std::string text;
+    text.reserve(phrase.size());
+    for (char ch : phrase) {
+        text.push_back(static_cast<char>(fold(ch)));
+    }
+
+    _phrases.push_back(Phrase{ std::move(text), id, wholeWord });
+    _compiled = false;
+}
+
+void TriggerMatcher::compile() {
+    // input classes: every byte which occurs in phrases gets its own class, upper case letters share the class
+    // of the lower case ones
+    _byteClass.fill(0);
+    _firstByte.fill(false);
+    _numClasses = 1;
+    for (const auto& phrase : _phrases) {
+        for (char ch : phrase.Text) {
+            auto& cls = _byteClass[static_cast<unsigned char>(ch)];
+            if (cls == 0) {
+                cls = static_cast<std::uint16_t>(_numClasses++);
+            }
+        }
+        const auto first = static_cast<unsigned char>(phrase.Text.front());
+        _firstByte[first] = true;
+        _firstByte[static_cast<unsigned char>(std::toupper(first))] = true;
+    }
+    for (int ch = 'A'; ch <= 'Z'; ++ch) {
+        _byteClass[ch] = _byteClass[ch - 'A' + 'a'];
+    }
+
+    // trie
+    _transitions.assign(_numClasses, NO_STATE);
+    std::vector<std::vector<std::uint32_t>> outputs(1);
+
+    for (std::uint32_t i = 0; i < _phrases.size(); ++i) {
+        std::uint32_t state = 0;
+        for (char ch : _phrases[i].Text) {
+            const std::size_t transition = state * _numClasses + _byteClass[static_cast<unsigned char>(ch)];
+            if (_transitions[transition] == NO_STATE) {
+                _transitions[transition] = static_cast<std::uint32_t>(outputs.size());
+                outputs.emplace_back();
+                _transitions.resize(_transitions.size() + _numClasses, NO_STATE);
+            }
+            state = _transitions[transition];
+        }
+        outputs[state].push_back(i);
+    }
+
+    // failure links in breadth-first order, missing transitions are resolved through them,
+    // so that matching takes exactly one transition per byte
+    std::vector<std::uint32_t> fail(outputs.size(), 0);
+    std::queue<std::uint32_t> queue;
+    for (std::size_t cls = 0; cls < _numClasses; ++cls) {
+        auto& next = _transitions[cls];
+        if (next == NO_STATE) {
+            next = 0;
+        } else {
+            queue.push(next);
+        }
+    }
+    while (!queue.empty()) {
+        const std::uint32_t state = queue.front();
+        queue.pop();
+
+        const auto& inherited = outputs[fail[state]];
+        outputs[state].insert(outputs[state].end(), inherited.begin(), inherited.end());
+
+        for (std::size_t cls = 0; cls < _numClasses; ++cls) {
+            auto& next = _transitions[state * _numClasses + cls];
+            const std::uint32_t fallback = _transitions[fail[state] * _numClasses + cls];
+            if (next == NO_STATE) {
+                next = fallback;
+            } else {
+                fail[next] = fallback;
+                queue.push(next);
+            }
+        }
+    }
+
+    _outputStart.clear();
+    _outputs.clear();
+    for (const auto& out : outputs) {
+        _outputStart.push_back(static_cast<std::uint32_t>(_outputs.size()));
+        _outputs.insert(_outputs.end(), out.begin(), out.end());
+    }
+    _outputStart.push_back(static_cast<std::uint32_t>(_outputs.size()));
+
+    _compiled = true;
+}
+
+bool TriggerMatcher::is_whole_word(std::string_view text, std::size_t position, std::size_t length) const {
+    const bool startsWord = position == 0 || !is_word_byte(text[position - 1]);
+    const bool endsWord = position + length == text.size() || !is_word_byte(text[position + length]);
+    return startsWord && endsWord;
+}
+
+void TriggerMatcher::find_all(std::string_view text, std::vector<Match>& matches) const {
+    if (!_compiled) {
+        throw std::logic_error("trigger matcher is not compiled");
+    }
+    if (_phrases.empty()) {
+        return;
+    }
+
+    std::uint32_t state = 0;
+    for (std::size_t i = 0; i < text.size(); ++i) {
+        if (state == 0) {
+            // prefilter: nothing can match until a byte which starts a phrase
+            while (i < text.size() && !_firstByte[static_cast<unsigned char>(text[i])]) {
+                ++i;
+            }
+            if (i == text.size()) {
+                break;
+            }
+        }
+
+        state = _transitions[state * _numClasses + _byteClass[static_cast<unsigned char>(text[i])]];
+
+        for (auto o = _outputStart[state]; o < _outputStart[state + 1]; ++o) {
+            const auto& phrase = _phrases[_outputs[o]];
+            const std::size_t length = phrase.Text.size();
+            const std::size_t position = i + 1 - length;
+            if (!phrase.WholeWord || is_whole_word(text, position, length)) {
+                matches.push_back(Match{ phrase.Id, position, length });
+            }
+        }
+    }
+}
+
+}
@@ -0,0 +1,236 @@
+#include "tgapi/bot/update_dispatcher.h"
+
+#include <algorithm>
+#include <boost/asio/post.hpp>
+
+namespace tg
+{
+
+UpdateDispatcher::UpdateDispatcher(boost::asio::any_io_executor executor, boost::asio::any_io_executor priorityExecutor,
+                                   DispatcherOptions options, Handler handler)
+    : _executor{ std::move(executor) }
+    , _priorityExecutor{ std::move(priorityExecutor) }
+    , _options{ options }
+    , _handler{ std::move(handler) }
+{
+    _options.HighWatermark = std::max<std::size_t>(_options.HighWatermark, 1);
+    _options.LowWatermark = std::min(_options.LowWatermark, _options.HighWatermark - 1);
+
+    lane(DispatchLane::DEFAULT).Workers = std::max<std::size_t>(_options.Workers, 1);
+    lane(DispatchLane::CALLBACK_QUERY).Workers = std::max<std::size_t>(_options.CallbackQueryWorkers, 1);
+    lane(DispatchLane::PRE_CHECKOUT_QUERY).Workers = std::max<std::size_t>(_options.PreCheckoutQueryWorkers, 1);
+    lane(DispatchLane::INLINE_QUERY).Workers = std::max<std::size_t>(_options.InlineQueryWorkers, 1);
+}
+
+std::size_t UpdateDispatcher::active() const {
+    const Lane& l = lane(DispatchLane::DEFAULT);
+    return l.Queue.size() + l.Running;
+}
+
+bool UpdateDispatcher::push(BotUpdate update, UpdateClass cls, bool replayed) {
+    std::unique_lock lock{ _mutex };
+
+    if (_closed) {
+        return false;
+    }
+
+    const auto now = Clock::now();
+
+    if (_paused && cls == UpdateClass::MESSAGE) {
+        switch(_options.Shedding) {
+            case SheddingPolicy::DROP:
+                ++_metrics.Shed;
+                return false;
+
+            case SheddingPolicy::DEFER:
+                // deferred messages are bounded separately, they are not counted by watermarks
+                if (_deferred.size() >= _options.HighWatermark) {
+                    ++_metrics.Shed;
+                    return false;
+                }
+                _deferred.push_back(Job{ std::move(update), cls, now, replayed });
+                ++_metrics.Deferred;
+                return true;
+
+            case SheddingPolicy::NONE:
+                break;
+        }
+    }
+
+    lane(lane_of(cls)).Queue.push_back(Job{ std::move(update), cls, now, replayed });
+
+    if (!_paused && active() >= _options.HighWatermark) {
+        _paused = true;
+        _pausedAt = now;
+        ++_metrics.Pauses;
+    }
+
+    start_workers(lock);
+    return true;
+}
+
+void UpdateDispatcher::start_workers(std::unique_lock<std::mutex>& lock) {
+    std::array<std::size_t, static_cast<std::size_t>(DispatchLane::COUNT)> toStart{};
+
+    for (std::size_t i = 0; i < _lanes.size(); ++i) {
+        Lane& l = _lanes[i];
+
+        std::size_t available = l.Queue.size();
+        if (i == static_cast<std::size_t>(DispatchLane::DEFAULT) && !_paused) {
+            available += _deferred.size();
+        }
+
+        while (l.Running + toStart[i] < l.Workers && toStart[i] < available) {
+            ++toStart[i];
+        }
+        l.Running += toStart[i];
+    }
+
+    lock.unlock();
+    for (std::size_t i = 0; i < _lanes.size(); ++i) {
+        const auto laneId = static_cast<DispatchLane>(i);
+        const auto& executor = laneId == DispatchLane::DEFAULT ? _executor : _priorityExecutor;
+        for (std::size_t j = 0; j < toStart[i]; ++j) {
+            boost::asio::post(executor, [this, laneId] { run_next(laneId); });
+        }
+    }
+    lock.lock();
+}
+
+void UpdateDispatcher::run_next(DispatchLane laneId) {
+    std::unique_lock lock{ _mutex };
+
+    Lane& l = lane(laneId);
+
+    std::deque<Job>* source = nullptr;
+    if (!l.Queue.empty()) {
+        source = &l.Queue;
+    } else if (laneId == DispatchLane::DEFAULT && !_paused && !_deferred.empty()) {
+        source = &_deferred;
+    }
+
+    if (_closed || source == nullptr) {
+        --l.Running;
+        return;
+    }
+
+    Job job{ std::move(source->front()) };
+    source->pop_front();
+    _runningIds.push_back(job.Update.Id);
+
+    lock.unlock();
+
+    const auto startedAt = Clock::now();
+    try {
+        _handler(job.Update, job.Class, job.Replayed);
+    } catch (...) {
+        // handler is responsible for reporting its errors
+    }
+    const auto finishedAt = Clock::now();
+
+    lock.lock();
+
+    {
+        using std::chrono::duration_cast;
+        using std::chrono::microseconds;
+
+        const auto latency = duration_cast<microseconds>(finishedAt - job.ReceivedAt);
+        l.Metrics.TotalWait += duration_cast<microseconds>(startedAt - job.ReceivedAt);
+        l.Metrics.TotalLatency += latency;
+        l.Metrics.MaxLatency = std::max(l.Metrics.MaxLatency, latency);
+        ++l.Metrics.Processed;
+    }
+
+    ++_metrics.Processed;
+    --l.Running;
+    ++_finishing;
+    _runningIds.erase(std::find(_runningIds.begin(), _runningIds.end(), job.Update.Id));
+
+    std::function<void()> resume;
+    if (_paused && active() <= _options.LowWatermark) {
+        _paused = false;
+        _metrics.PausedTime += std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - _pausedAt);
+        resume = _onResume;
+    }
+
+    // yield the executor to other bots before taking the next update
+    start_workers(lock);
+    lock.unlock();
+
+    if (resume) {
+        try {
+            resume();
+        } catch (...) {
+            --_finishing;
+            throw;
+        }
+    }
+    // last use of the dispatcher, owner may be destroyed once it is idle
+    --_finishing;
+}
+
+void UpdateDispatcher::set_resume_callback(std::function<void()> cb) {
+    std::unique_lock lock{ _mutex };
+    _onResume = std::move(cb);
+}
+
+std::optional<long> UpdateDispatcher::close() {
+    std::unique_lock lock{ _mutex };
+    _closed = true;
+
+    std::optional<long> oldest;
+    auto visit = [&oldest](long id) {
+        oldest = oldest ? std::min(*oldest, id) : id;
+    };
+
+    for (auto& l : _lanes) {
+        for (const auto& job : l.Queue) {
+            visit(job.Update.Id);
+        }
+        l.Queue.clear();
+    }
+    for (const auto& job : _deferred) {
+        visit(job.Update.Id);
+    }
+    for (long id : _runningIds) {
+        visit(id);
+    }
+
+    _deferred.clear();
+    return oldest;
+}
+
+bool UpdateDispatcher::is_idle() const {
+    std::unique_lock lock{ _mutex };
+    if (!_deferred.empty() || _finishing > 0) {
+        return false;
+    }
+    return std::all_of(_lanes.begin(), _lanes.end(), [](const Lane& l) {
+        return l.Queue.empty() && l.Running == 0;
+    });
+}
+
+bool UpdateDispatcher::is_paused() const {
+    std::unique_lock lock{ _mutex };
+    return _paused;
+}
+
+DispatchMetrics UpdateDispatcher::get_metrics() const {
+    std::unique_lock lock{ _mutex };
+    DispatchMetrics m = _metrics;
+    m.DeferredDepth = _deferred.size();
+    for (std::size_t i = 0; i < _lanes.size(); ++i) {
+        m.Lanes[i] = _lanes[i].Metrics;
+        m.Lanes[i].QueueDepth = _lanes[i].Queue.size();
+        m.Lanes[i].Running = _lanes[i].Running;
+
+        m.QueueDepth += _lanes[i].Queue.size();
+        m.Running += _lanes[i].Running;
+    }
+    if (_paused) {
+        m.PausedTime += std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - _pausedAt);
+    }
+    return m;
+}
+
+}
@@ -0,0 +1,100 @@
+#include "tgapi/bot/update_recorder.h"
+
+#include <array>
+#include <stdexcept>
+
+#include "tgapi/fmt/tgbot_fmt.h"
+
+namespace tg
+{
+
+namespace {
+
+constexpr std::string_view CAPTURE_MAGIC = "TGCAP";
+constexpr char CAPTURE_VERSION = 1;
+
+template<typename T>
+void write_le(std::ostream& os, T value) {
+    std::array<char, sizeof(T)> bytes{};
+    for (std::size_t i = 0; i < sizeof(T); ++i) {
+        bytes[i] = static_cast<char>((static_cast<std::uint64_t>(value) >> (8 * i)) & 0xFF);
+    }
+    os.write(bytes.data(), bytes.size());
+}
+
+template<typename T>
+bool read_le(std::istream& is, T& value) {
+    std::array<unsigned char, sizeof(T)> bytes{};
+    if (!is.read(reinterpret_cast<char*>(bytes.data()), bytes.size())) {
+        return false;
+    }
+    std::uint64_t result = 0;
+    for (std::size_t i = 0; i < sizeof(T); ++i) {
+        result |= static_cast<std::uint64_t>(bytes[i]) << (8 * i);
+    }
+    value = static_cast<T>(result);
+    return true;
+}
+
+}
+
+UpdateRecorder::UpdateRecorder(const std::filesystem::path& path) {
+    const bool exists = std::filesystem::exists(path) && std::filesystem::file_size(path) > 0;
+
+    _ofs.open(path, std::ios_base::binary | std::ios_base::app);
+    if (!_ofs.is_open()) {
+        throw std::runtime_error(fmt::format(R"("{}": failed to open capture file)", path));
+    }
+
+    if (!exists) {
+        _ofs.write(CAPTURE_MAGIC.data(), CAPTURE_MAGIC.size());
+        _ofs.put(CAPTURE_VERSION);
+        _ofs.flush();
+    }
+}
+
+void UpdateRecorder::append(CaptureRecord::Kind kind, std::string_view payload) {
+    namespace chrono = std::chrono;
+    const auto now = chrono::duration_cast<chrono::microseconds>(chrono::system_clock::now().time_since_epoch());
+
+    std::unique_lock lock{ _mutex };
+    _ofs.put(static_cast<char>(kind));
+    write_le<std::int64_t>(_ofs, now.count());
+    write_le<std::uint32_t>(_ofs, static_cast<std::uint32_t>(payload.size()));
+    _ofs.write(payload.data(), static_cast<std::streamsize>(payload.size()));
+    _ofs.flush();
+}
+
+CaptureReader::CaptureReader(const std::filesystem::path& path) {
+    _ifs.open(path, std::ios_base::binary);
+    if (!_ifs.is_open()) {
+        throw std::runtime_error(fmt::format(R"("{}": failed to open capture file)", path));
+    }
+
+    std::array<char, CAPTURE_MAGIC.size() + 1> header{};
+    if (!_ifs.read(header.data(), header.size())
+        || std::string_view{ header.data(), CAPTURE_MAGIC.size() } != CAPTURE_MAGIC
+        || header.back() != CAPTURE_VERSION) {
+        throw std::runtime_error(fmt::format(R"("{}": not a capture file)", path));
+    }
+}
+
+bool CaptureReader::next(CaptureRecord& record) {
+    const int kind = _ifs.get();
+    if (kind == std::char_traits<char>::eof()) {
+        return false;
+    }
+
+    std::int64_t receivedAt;
+    std::uint32_t length;
+    if (!read_le(_ifs, receivedAt) || !read_le(_ifs, length)) {
+        return false; // truncated record
+    }
+
+    record.Type = static_cast<CaptureRecord::Kind>(kind);
+    record.ReceivedAt = std::chrono::microseconds{ receivedAt };
+    record.Payload.resize(length);
+    return static_cast<bool>(_ifs.read(record.Payload.data(), length));
+}
+
+}